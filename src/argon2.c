@@ -0,0 +1,917 @@
+/**
+ * @file argon2.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Argon2id, version 0x13, as specified in RFC 9106.  The portable
+ * reference block compression is always compiled.  Where SSE2 is
+ * available, an optimized compression that keeps the previous block in
+ * registers is used instead.  The two are cross-checked by
+ * argon2_self_test().  The lanes of each slice are filled in parallel
+ * threads, when threads are available.  The threads are started once for
+ * each hash and wait for each other at the end of each slice.
+ */
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+#define B2B_BLOCK_LEN           128
+#define B2B_OUT_LEN             64
+#define ARGON2_VERSION          0x13
+#define ARGON2_TYPE_ID          2
+#define ARGON2_SYNC_POINTS      4
+#define ARGON2_QWORDS_IN_BLOCK  (ARGON2_BLOCK_SIZE / 8)
+#define ARGON2_ADDRESSES_IN_BLOCK ARGON2_QWORDS_IN_BLOCK
+#define ARGON2_PREHASH_LEN      B2B_OUT_LEN
+#define ARGON2_PREHASH_SEED_LEN (ARGON2_PREHASH_LEN + 8)
+
+static uint64_t const b2b_iv[8] = {
+    0x6A09E667F3BCC908ULL, 0xBB67AE8584CAA73BULL,
+    0x3C6EF372FE94F82BULL, 0xA54FF53A5F1D36F1ULL,
+    0x510E527FADE682D1ULL, 0x9B05688C2B3E6C1FULL,
+    0x1F83D9ABFB41BD6BULL, 0x5BE0CD19137E2179ULL
+};
+
+static unsigned char const b2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+#define ROTR64(_w, _c)  (((_w) >> (_c)) | ((_w) << (64 - (_c))))
+
+#define B2B_G(_v, _a, _b, _c, _d, _x, _y) do {                  \
+        _v[_a] = _v[_a] + _v[_b] + (_x);                        \
+        _v[_d] = ROTR64(_v[_d] ^ _v[_a], 32);                   \
+        _v[_c] = _v[_c] + _v[_d];                               \
+        _v[_b] = ROTR64(_v[_b] ^ _v[_c], 24);                   \
+        _v[_a] = _v[_a] + _v[_b] + (_y);                        \
+        _v[_d] = ROTR64(_v[_d] ^ _v[_a], 16);                   \
+        _v[_c] = _v[_c] + _v[_d];                               \
+        _v[_b] = ROTR64(_v[_b] ^ _v[_c], 63);                   \
+    } while (0)
+
+/*
+ * The BlaMka variant of the BLAKE2b mixing function: the additions
+ * carry an extra "2 * low(a) * low(b)" term.
+ */
+#define BLAMKA(_x, _y) \
+    ((_x) + (_y) + 2 * ((_x) & 0xFFFFFFFFULL) * ((_y) & 0xFFFFFFFFULL))
+
+#define ARGON2_G(_a, _b, _c, _d) do {                           \
+        _a = BLAMKA(_a, _b); _d = ROTR64(_d ^ _a, 32);          \
+        _c = BLAMKA(_c, _d); _b = ROTR64(_b ^ _c, 24);          \
+        _a = BLAMKA(_a, _b); _d = ROTR64(_d ^ _a, 16);          \
+        _c = BLAMKA(_c, _d); _b = ROTR64(_b ^ _c, 63);          \
+    } while (0)
+
+#define ARGON2_ROUND(_v, _i0, _i1, _i2, _i3, _i4, _i5, _i6, _i7,      \
+                     _i8, _i9, _i10, _i11, _i12, _i13, _i14, _i15) do { \
+        ARGON2_G(_v[_i0], _v[_i4], _v[_i8],  _v[_i12]);         \
+        ARGON2_G(_v[_i1], _v[_i5], _v[_i9],  _v[_i13]);         \
+        ARGON2_G(_v[_i2], _v[_i6], _v[_i10], _v[_i14]);         \
+        ARGON2_G(_v[_i3], _v[_i7], _v[_i11], _v[_i15]);         \
+        ARGON2_G(_v[_i0], _v[_i5], _v[_i10], _v[_i15]);         \
+        ARGON2_G(_v[_i1], _v[_i6], _v[_i11], _v[_i12]);         \
+        ARGON2_G(_v[_i2], _v[_i7], _v[_i8],  _v[_i13]);         \
+        ARGON2_G(_v[_i3], _v[_i4], _v[_i9],  _v[_i14]);         \
+    } while (0)
+
+////LIB-HEADERS:
+
+/**
+ * Load a little endian 64 bit value.
+ */
+static inline uint64_t
+load64_le(unsigned char const * p)
+{
+    return  (uint64_t)p[0]        | ((uint64_t)p[1] <<  8)
+        | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24)
+        | ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40)
+        | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+/**
+ * Store a little endian 64 bit value.
+ */
+static inline void
+store64_le(unsigned char * p, uint64_t v)
+{
+    int ct = 8;
+    do  {
+        *(p++) = (unsigned char)v;
+        v >>= 8;
+    } while (--ct > 0);
+}
+
+/**
+ * Store a little endian 32 bit value.
+ */
+static inline void
+store32_le(unsigned char * p, uint32_t v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/**
+ * BLAKE2b compression of one 128 byte block.
+ *
+ * @param ctx   the hash state
+ * @param last  true for the final block
+ */
+static void
+b2b_compress(b2b_ctx_t * ctx, bool last)
+{
+    uint64_t v[16], m[16];
+    int ix;
+
+    for (ix = 0; ix < 8; ix++) {
+        v[ix]     = ctx->h[ix];
+        v[ix + 8] = b2b_iv[ix];
+    }
+    v[12] ^= ctx->t[0];
+    v[13] ^= ctx->t[1];
+    if (last)
+        v[14] = ~v[14];
+
+    for (ix = 0; ix < 16; ix++)
+        m[ix] = load64_le(ctx->b + (8 * ix));
+
+    for (ix = 0; ix < 12; ix++) {
+        unsigned char const * s = b2b_sigma[ix];
+        B2B_G(v, 0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+        B2B_G(v, 1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+        B2B_G(v, 2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+        B2B_G(v, 3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+        B2B_G(v, 0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+        B2B_G(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        B2B_G(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+        B2B_G(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+
+    for (ix = 0; ix < 8; ix++)
+        ctx->h[ix] ^= v[ix] ^ v[ix + 8];
+}
+
+/**
+ * Initialize an unkeyed BLAKE2b hash.
+ *
+ * @param ctx      the hash state
+ * @param out_len  digest length, 1 to 64 bytes
+ */
+static void
+b2b_init(b2b_ctx_t * ctx, size_t out_len)
+{
+    int ix;
+    for (ix = 0; ix < 8; ix++)
+        ctx->h[ix] = b2b_iv[ix];
+    ctx->h[0] ^= 0x01010000ULL ^ out_len;
+    ctx->t[0]   = ctx->t[1] = 0;
+    ctx->c      = 0;
+    ctx->outlen = out_len;
+}
+
+/**
+ * Add data to a BLAKE2b hash.
+ */
+static void
+b2b_update(b2b_ctx_t * ctx, void const * data, size_t len)
+{
+    unsigned char const * in = data;
+
+    while (len-- > 0) {
+        if (ctx->c == B2B_BLOCK_LEN) {
+            ctx->t[0] += ctx->c;
+            if (ctx->t[0] < ctx->c)
+                ctx->t[1]++;
+            b2b_compress(ctx, false);
+            ctx->c = 0;
+        }
+        ctx->b[ctx->c++] = *(in++);
+    }
+}
+
+/**
+ * Finish a BLAKE2b hash.
+ *
+ * @param ctx  the hash state
+ * @param out  digest output, \a ctx->outlen bytes
+ */
+static void
+b2b_final(b2b_ctx_t * ctx, unsigned char * out)
+{
+    size_t ix;
+
+    ctx->t[0] += ctx->c;
+    if (ctx->t[0] < ctx->c)
+        ctx->t[1]++;
+
+    while (ctx->c < B2B_BLOCK_LEN)
+        ctx->b[ctx->c++] = 0;
+    b2b_compress(ctx, true);
+
+    for (ix = 0; ix < ctx->outlen; ix++)
+        out[ix] = (unsigned char)(ctx->h[ix >> 3] >> (8 * (ix & 7)));
+}
+
+/**
+ * The Argon2 variable length hash function, H' in RFC 9106.
+ *
+ * @param out      output buffer
+ * @param out_len  output length
+ * @param in       input data
+ * @param in_len   input length
+ */
+static void
+argon2_hash_long(unsigned char * out, size_t out_len,
+                 void const * in, size_t in_len)
+{
+    unsigned char len_buf[4];
+    b2b_ctx_t ctx;
+
+    store32_le(len_buf, (uint32_t)out_len);
+
+    if (out_len <= B2B_OUT_LEN) {
+        b2b_init(&ctx, out_len);
+        b2b_update(&ctx, len_buf, sizeof(len_buf));
+        b2b_update(&ctx, in, in_len);
+        b2b_final(&ctx, out);
+        return;
+    }
+
+    {
+        unsigned char v[B2B_OUT_LEN];
+
+        b2b_init(&ctx, B2B_OUT_LEN);
+        b2b_update(&ctx, len_buf, sizeof(len_buf));
+        b2b_update(&ctx, in, in_len);
+        b2b_final(&ctx, v);
+
+        memcpy(out, v, B2B_OUT_LEN / 2);
+        out     += B2B_OUT_LEN / 2;
+        out_len -= B2B_OUT_LEN / 2;
+
+        while (out_len > B2B_OUT_LEN) {
+            b2b_init(&ctx, B2B_OUT_LEN);
+            b2b_update(&ctx, v, B2B_OUT_LEN);
+            b2b_final(&ctx, v);
+            memcpy(out, v, B2B_OUT_LEN / 2);
+            out     += B2B_OUT_LEN / 2;
+            out_len -= B2B_OUT_LEN / 2;
+        }
+
+        b2b_init(&ctx, out_len);
+        b2b_update(&ctx, v, B2B_OUT_LEN);
+        b2b_final(&ctx, out);
+    }
+}
+
+/**
+ * The reference block compression: G(prev xor ref), optionally
+ * xor-ed into the existing block (passes after the first).
+ *
+ * @param prev       the previous block
+ * @param ref        the reference block
+ * @param next       the block to fill
+ * @param with_xor   merge into the old content of \a next
+ */
+static void
+argon2_fill_block_ref(argon2_block_t const * prev, argon2_block_t const * ref,
+                      argon2_block_t * next, bool with_xor)
+{
+    argon2_block_t r, tmp;
+    int ix;
+
+    for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK; ix++)
+        r.v[ix] = tmp.v[ix] = ref->v[ix] ^ prev->v[ix];
+
+    if (with_xor)
+        for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK; ix++)
+            tmp.v[ix] ^= next->v[ix];
+
+    /*
+     * Apply the permutation to each row of 16 words, then to each
+     * column of 2 words in each of the 8 rows.
+     */
+    for (ix = 0; ix < 8; ix++) {
+        int b = 16 * ix;
+        ARGON2_ROUND(r.v, b, b+1, b+2,  b+3,  b+4,  b+5,  b+6,  b+7,
+                     b+8, b+9, b+10, b+11, b+12, b+13, b+14, b+15);
+    }
+
+    for (ix = 0; ix < 8; ix++) {
+        int b = 2 * ix;
+        ARGON2_ROUND(r.v, b,    b+1,  b+16, b+17, b+32, b+33, b+48, b+49,
+                     b+64, b+65, b+80, b+81, b+96, b+97, b+112, b+113);
+    }
+
+    for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK; ix++)
+        next->v[ix] = tmp.v[ix] ^ r.v[ix];
+}
+
+#ifdef __SSE2__
+/**
+ * The optimized block compression.  Two 64 bit words per register;
+ * the BlaMka multiply is a single pmuludq.
+ */
+static void
+argon2_fill_block_sse2(argon2_block_t const * prev, argon2_block_t const * ref,
+                       argon2_block_t * next, bool with_xor)
+{
+#   define SSE_BLAMKA(_x, _y) __extension__ ({                        \
+        __m128i z_ = _mm_mul_epu32((_x), (_y));                         \
+        _mm_add_epi64(_mm_add_epi64((_x), (_y)), _mm_add_epi64(z_, z_)); })
+
+#   define SSE_ROTR(_x, _c)                                            \
+    (((_c) == 32) ? _mm_shuffle_epi32((_x), _MM_SHUFFLE(2, 3, 0, 1))    \
+     : ((_c) == 63) ? _mm_xor_si128(_mm_srli_epi64((_x), 63),           \
+                                    _mm_add_epi64((_x), (_x)))          \
+     : _mm_xor_si128(_mm_srli_epi64((_x), (_c)),                        \
+                     _mm_slli_epi64((_x), 64 - (_c))))
+
+#   define SSE_G(_A0, _A1, _B0, _B1, _C0, _C1, _D0, _D1, _r1, _r2) do { \
+        _A0 = SSE_BLAMKA(_A0, _B0); _A1 = SSE_BLAMKA(_A1, _B1);         \
+        _D0 = SSE_ROTR(_mm_xor_si128(_D0, _A0), _r1);                   \
+        _D1 = SSE_ROTR(_mm_xor_si128(_D1, _A1), _r1);                   \
+        _C0 = SSE_BLAMKA(_C0, _D0); _C1 = SSE_BLAMKA(_C1, _D1);         \
+        _B0 = SSE_ROTR(_mm_xor_si128(_B0, _C0), _r2);                   \
+        _B1 = SSE_ROTR(_mm_xor_si128(_B1, _C1), _r2);                   \
+    } while (0)
+
+#   define SSE_DIAG(_B0, _B1, _C0, _C1, _D0, _D1) do {                 \
+        __m128i b_ = _B0, c_ = _C0, d_ = _D0;                           \
+        _B0 = _mm_unpackhi_epi64(_B0, _mm_unpacklo_epi64(_B1, _B1));    \
+        _B1 = _mm_unpackhi_epi64(_B1, _mm_unpacklo_epi64(b_, b_));      \
+        _C0 = _C1; _C1 = c_;                                            \
+        _D0 = _mm_unpackhi_epi64(_D1, _mm_unpacklo_epi64(_D0, _D0));    \
+        _D1 = _mm_unpackhi_epi64(d_, _mm_unpacklo_epi64(_D1, _D1));     \
+    } while (0)
+
+#   define SSE_UNDIAG(_B0, _B1, _C0, _C1, _D0, _D1) do {               \
+        __m128i b_ = _B0, c_ = _C0, d_ = _D0;                           \
+        _B0 = _mm_unpackhi_epi64(_B1, _mm_unpacklo_epi64(_B0, _B0));    \
+        _B1 = _mm_unpackhi_epi64(b_, _mm_unpacklo_epi64(_B1, _B1));     \
+        _C0 = _C1; _C1 = c_;                                            \
+        _D0 = _mm_unpackhi_epi64(_D0, _mm_unpacklo_epi64(_D1, _D1));    \
+        _D1 = _mm_unpackhi_epi64(_D1, _mm_unpacklo_epi64(d_, d_));      \
+    } while (0)
+
+#   define SSE_ROUND(_A0, _A1, _B0, _B1, _C0, _C1, _D0, _D1) do {      \
+        SSE_G(_A0, _A1, _B0, _B1, _C0, _C1, _D0, _D1, 32, 24);          \
+        SSE_G(_A0, _A1, _B0, _B1, _C0, _C1, _D0, _D1, 16, 63);          \
+        SSE_DIAG(_B0, _B1, _C0, _C1, _D0, _D1);                         \
+        SSE_G(_A0, _A1, _B0, _B1, _C0, _C1, _D0, _D1, 32, 24);          \
+        SSE_G(_A0, _A1, _B0, _B1, _C0, _C1, _D0, _D1, 16, 63);          \
+        SSE_UNDIAG(_B0, _B1, _C0, _C1, _D0, _D1);                       \
+    } while (0)
+
+    __m128i s[ARGON2_QWORDS_IN_BLOCK / 2];
+    __m128i xy[ARGON2_QWORDS_IN_BLOCK / 2];
+    int ix;
+
+    for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK / 2; ix++) {
+        __m128i r = _mm_loadu_si128((__m128i const *)(ref->v + 2 * ix));
+        __m128i p = _mm_loadu_si128((__m128i const *)(prev->v + 2 * ix));
+        s[ix] = xy[ix] = _mm_xor_si128(r, p);
+        if (with_xor)
+            xy[ix] = _mm_xor_si128(xy[ix],
+                _mm_loadu_si128((__m128i const *)(next->v + 2 * ix)));
+    }
+
+    for (ix = 0; ix < 8; ix++)
+        SSE_ROUND(s[8*ix + 0], s[8*ix + 1], s[8*ix + 2], s[8*ix + 3],
+                  s[8*ix + 4], s[8*ix + 5], s[8*ix + 6], s[8*ix + 7]);
+
+    for (ix = 0; ix < 8; ix++)
+        SSE_ROUND(s[8*0 + ix], s[8*1 + ix], s[8*2 + ix], s[8*3 + ix],
+                  s[8*4 + ix], s[8*5 + ix], s[8*6 + ix], s[8*7 + ix]);
+
+    for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK / 2; ix++)
+        _mm_storeu_si128((__m128i *)(next->v + 2 * ix),
+                         _mm_xor_si128(s[ix], xy[ix]));
+
+#   undef SSE_ROUND
+#   undef SSE_UNDIAG
+#   undef SSE_DIAG
+#   undef SSE_G
+#   undef SSE_ROTR
+#   undef SSE_BLAMKA
+}
+#endif // __SSE2__
+
+/**
+ * Compute the next block of pseudo-random reference addresses for
+ * data independent addressing.
+ */
+static void
+argon2_next_addresses(argon2_inst_t * inst, argon2_block_t * addr,
+                      argon2_block_t * input, argon2_block_t const * zero)
+{
+    input->v[6]++;
+    inst->ai_fill(zero, input, addr, false);
+    inst->ai_fill(zero, addr,  addr, false);
+}
+
+/**
+ * Map a pseudo-random value to the index of a reference block within
+ * the reference lane.
+ *
+ * @param inst       the argon2 instance
+ * @param pass       current pass
+ * @param slice      current slice
+ * @param index      block index within the segment
+ * @param rand       the low 32 bits of the pseudo-random value
+ * @param same_lane  whether the reference lane is the current lane
+ *
+ * @returns the index within the reference lane
+ */
+static uint32_t
+argon2_index_alpha(argon2_inst_t const * inst, uint32_t pass, uint32_t slice,
+                   uint32_t index, uint32_t rand, bool same_lane)
+{
+    uint32_t const seg_len  = inst->ai_seg_len;
+    uint32_t const lane_len = inst->ai_lane_len;
+    uint32_t area;
+    uint32_t start = 0;
+    uint64_t rel;
+
+    if (pass == 0) {
+        if (slice == 0)
+            area = index - 1;
+        else if (same_lane)
+            area = slice * seg_len + index - 1;
+        else
+            area = slice * seg_len + ((index == 0) ? -1 : 0);
+
+    } else {
+        if (same_lane)
+            area = lane_len - seg_len + index - 1;
+        else
+            area = lane_len - seg_len + ((index == 0) ? -1 : 0);
+
+        if (slice != ARGON2_SYNC_POINTS - 1)
+            start = (slice + 1) * seg_len;
+    }
+
+    rel = rand;
+    rel = (rel * rel) >> 32;
+    rel = area - 1 - ((area * rel) >> 32);
+
+    return (uint32_t)((start + rel) % lane_len);
+}
+
+/**
+ * Fill one segment: one slice of one lane.
+ */
+static void
+argon2_fill_segment(argon2_inst_t * inst, uint32_t pass, uint32_t lane,
+                    uint32_t slice)
+{
+    argon2_block_t addr, input, zero;
+    bool const indep = (pass == 0) && (slice < ARGON2_SYNC_POINTS / 2);
+    uint32_t   start = 0;
+    uint32_t   ix;
+    uint64_t   curr, prev;
+
+    if (indep) {
+        memset(&zero,  0, sizeof(zero));
+        memset(&input, 0, sizeof(input));
+        input.v[0] = pass;
+        input.v[1] = lane;
+        input.v[2] = slice;
+        input.v[3] = inst->ai_blocks;
+        input.v[4] = inst->ai_passes;
+        input.v[5] = ARGON2_TYPE_ID;
+    }
+
+    /*
+     * The first two blocks of each lane are computed from the prehash.
+     */
+    if ((pass == 0) && (slice == 0)) {
+        start = 2;
+        if (indep)
+            argon2_next_addresses(inst, &addr, &input, &zero);
+    }
+
+    curr = (uint64_t)lane * inst->ai_lane_len
+        + (uint64_t)slice * inst->ai_seg_len + start;
+    prev = ((curr % inst->ai_lane_len) == 0)
+        ? curr + inst->ai_lane_len - 1 : curr - 1;
+
+    for (ix = start; ix < inst->ai_seg_len; ix++, curr++, prev++) {
+        uint64_t rand;
+        uint32_t ref_lane;
+        uint32_t ref_ix;
+
+        if ((curr % inst->ai_lane_len) == 1)
+            prev = curr - 1;
+
+        if (indep) {
+            if ((ix % ARGON2_ADDRESSES_IN_BLOCK) == 0)
+                argon2_next_addresses(inst, &addr, &input, &zero);
+            rand = addr.v[ix % ARGON2_ADDRESSES_IN_BLOCK];
+        } else
+            rand = inst->ai_mem[prev].v[0];
+
+        ref_lane = (uint32_t)((rand >> 32) % inst->ai_lanes);
+        if ((pass == 0) && (slice == 0))
+            ref_lane = lane;
+
+        ref_ix = argon2_index_alpha(inst, pass, slice, ix,
+                                    (uint32_t)rand, ref_lane == lane);
+
+        inst->ai_fill(inst->ai_mem + prev,
+                      inst->ai_mem + ((uint64_t)inst->ai_lane_len * ref_lane)
+                      + ref_ix,
+                      inst->ai_mem + curr, pass != 0);
+    }
+}
+
+/**
+ * Fill the segments of every "thread count"th lane of one slice,
+ * starting with \a first.
+ */
+static void
+argon2_fill_slice(argon2_inst_t * inst, uint32_t pass, uint32_t slice,
+                  uint32_t first)
+{
+    uint32_t lane;
+
+    for (lane = first; lane < inst->ai_lanes; lane += inst->ai_threads)
+        argon2_fill_segment(inst, pass, lane, slice);
+}
+
+#ifdef HAVE_PTHREAD_H
+/**
+ * Wait for every thread of the crew to get here.  The last one to
+ * arrive starts the next round.
+ */
+static void
+argon2_crew_wait(argon2_crew_t * crew)
+{
+    uint32_t round;
+
+    pthread_mutex_lock(&crew->ac_lock);
+    round = crew->ac_round;
+    if (++crew->ac_waiting == crew->ac_inst->ai_threads) {
+        crew->ac_waiting = 0;
+        crew->ac_round++;
+        pthread_cond_broadcast(&crew->ac_cond);
+    } else {
+        while (crew->ac_round == round)
+            pthread_cond_wait(&crew->ac_cond, &crew->ac_lock);
+    }
+    pthread_mutex_unlock(&crew->ac_lock);
+}
+
+/**
+ * Fill one thread's share of every slice of every pass.
+ *
+ * @param crew   the lane threads
+ * @param first  the first lane of this thread
+ */
+static void
+argon2_crew_fill(argon2_crew_t * crew, uint32_t first)
+{
+    argon2_inst_t * inst = crew->ac_inst;
+    uint32_t pass, slice;
+
+    for (pass = 0; pass < inst->ai_passes; pass++)
+        for (slice = 0; slice < ARGON2_SYNC_POINTS; slice++) {
+            argon2_fill_slice(inst, pass, slice, first);
+            argon2_crew_wait(crew);
+        }
+}
+
+/**
+ * Thread start routine:  wait until the thread count is settled,
+ * then fill this thread's lanes.
+ */
+static void *
+argon2_thread(void * arg)
+{
+    argon2_job_t *  job  = arg;
+    argon2_crew_t * crew = job->aj_crew;
+
+    pthread_mutex_lock(&crew->ac_lock);
+    while (crew->ac_round == 0)
+        pthread_cond_wait(&crew->ac_cond, &crew->ac_lock);
+    pthread_mutex_unlock(&crew->ac_lock);
+
+    argon2_crew_fill(crew, job->aj_first);
+    return NULL;
+}
+
+/**
+ * Start the lane threads and fill the memory with them.  The calling
+ * thread fills the first lanes.  If fewer threads start than were
+ * wanted, the lanes are spread over the ones that did.
+ */
+static void
+argon2_fill_threaded(argon2_inst_t * inst)
+{
+    pthread_t     tid[ARGON2_MAX_LANES];
+    argon2_job_t  job[ARGON2_MAX_LANES];
+    argon2_crew_t crew = {
+        .ac_inst = inst, .ac_waiting = 0, .ac_round = 0 };
+    uint32_t      started = 0;
+
+    pthread_mutex_init(&crew.ac_lock, NULL);
+    pthread_cond_init(&crew.ac_cond, NULL);
+
+    /*
+     * The workers hold at round zero until the thread count is known.
+     */
+    pthread_mutex_lock(&crew.ac_lock);
+    while (started + 1 < inst->ai_threads) {
+        job[started].aj_crew  = &crew;
+        job[started].aj_first = started + 1;
+        if (pthread_create(tid + started, NULL, argon2_thread,
+                           job + started) != 0)
+            break;
+        started++;
+    }
+    inst->ai_threads = started + 1;
+    crew.ac_round    = 1;
+    pthread_cond_broadcast(&crew.ac_cond);
+    pthread_mutex_unlock(&crew.ac_lock);
+
+    argon2_crew_fill(&crew, 0);
+
+    while (started > 0)
+        pthread_join(tid[--started], NULL);
+    pthread_cond_destroy(&crew.ac_cond);
+    pthread_mutex_destroy(&crew.ac_lock);
+}
+#endif // HAVE_PTHREAD_H
+
+/**
+ * Fill all of the memory blocks, one slice at a time.  Lanes within a
+ * slice are independent of each other and may be filled in parallel.
+ */
+static void
+argon2_fill_memory(argon2_inst_t * inst)
+{
+    uint32_t pass, slice;
+
+#ifdef HAVE_PTHREAD_H
+    if (inst->ai_threads > 1) {
+        argon2_fill_threaded(inst);
+        return;
+    }
+#endif
+
+    inst->ai_threads = 1;
+    for (pass = 0; pass < inst->ai_passes; pass++)
+        for (slice = 0; slice < ARGON2_SYNC_POINTS; slice++)
+            argon2_fill_slice(inst, pass, slice, 0);
+}
+
+/**
+ * Compute an Argon2id hash.
+ *
+ * @param out         the tag output
+ * @param out_len     tag length, at least 4 bytes
+ * @param pw          the password
+ * @param pw_len      password length
+ * @param salt        the salt, at least 8 bytes
+ * @param salt_len    salt length
+ * @param secret      optional secret (key), may be NULL
+ * @param secret_len  secret length
+ * @param ad          optional associated data, may be NULL
+ * @param ad_len      associated data length
+ * @param passes      time cost: number of passes over memory
+ * @param mem_kib     memory cost in KiB
+ * @param lanes       parallelism: number of lanes
+ * @param threads     lane threads, or zero for one per processor
+ * @param impl        ARGON2_IMPL_REF or ARGON2_IMPL_OPT
+ *
+ * @returns GC_OK, GC_MALLOC_ERROR or GC_INVALID_HASH
+ */
+static int
+argon2id_hash(unsigned char * out, size_t out_len,
+              void const * pw, size_t pw_len,
+              void const * salt, size_t salt_len,
+              void const * secret, size_t secret_len,
+              void const * ad, size_t ad_len,
+              uint32_t passes, uint32_t mem_kib, uint32_t lanes,
+              uint32_t threads, argon2_impl_t impl)
+{
+    unsigned char blockhash[ARGON2_PREHASH_SEED_LEN];
+    unsigned char len_buf[4];
+    argon2_inst_t inst;
+    uint32_t      lane;
+
+    if (  (out_len < 4) || (salt_len < 8) || (passes < 1)
+       || (lanes < 1) || (lanes > ARGON2_MAX_LANES)
+       || (mem_kib < 8 * lanes))
+        return GC_INVALID_HASH;
+
+    {
+        uint32_t blocks = mem_kib;
+        if (blocks < 2 * ARGON2_SYNC_POINTS * lanes)
+            blocks = 2 * ARGON2_SYNC_POINTS * lanes;
+
+        inst.ai_seg_len  = blocks / (lanes * ARGON2_SYNC_POINTS);
+        inst.ai_lane_len = inst.ai_seg_len * ARGON2_SYNC_POINTS;
+        inst.ai_blocks   = inst.ai_lane_len * lanes;
+    }
+    inst.ai_passes  = passes;
+    inst.ai_lanes   = lanes;
+    inst.ai_threads = 1;
+    inst.ai_fill    = argon2_fill_block_ref;
+#ifdef __SSE2__
+    if (impl == ARGON2_IMPL_OPT)
+        inst.ai_fill = argon2_fill_block_sse2;
+#endif
+#ifdef HAVE_PTHREAD_H
+    if (threads == 0) {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (ncpu > 1) ? (uint32_t)ncpu : 1;
+    }
+    inst.ai_threads = (threads < lanes) ? threads : lanes;
+#else
+    (void)threads;
+#endif
+
+    inst.ai_mem = malloc((size_t)inst.ai_blocks * sizeof(argon2_block_t));
+    if (inst.ai_mem == NULL)
+        return GC_MALLOC_ERROR;
+
+    /*
+     * H0: the prehash of all the parameters and inputs
+     */
+    {
+        b2b_ctx_t ctx;
+        uint32_t const hdr[6] = {
+            lanes, (uint32_t)out_len, mem_kib, passes,
+            ARGON2_VERSION, ARGON2_TYPE_ID };
+        int ix;
+
+        b2b_init(&ctx, ARGON2_PREHASH_LEN);
+        for (ix = 0; ix < 6; ix++) {
+            store32_le(len_buf, hdr[ix]);
+            b2b_update(&ctx, len_buf, sizeof(len_buf));
+        }
+
+#       define B2B_ADD_FIELD(_p, _l) do {                       \
+            store32_le(len_buf, (uint32_t)(_l));                \
+            b2b_update(&ctx, len_buf, sizeof(len_buf));         \
+            if ((_l) > 0) b2b_update(&ctx, (_p), (_l));         \
+        } while (0)
+
+        B2B_ADD_FIELD(pw,     pw_len);
+        B2B_ADD_FIELD(salt,   salt_len);
+        B2B_ADD_FIELD(secret, secret_len);
+        B2B_ADD_FIELD(ad,     ad_len);
+#       undef B2B_ADD_FIELD
+
+        b2b_final(&ctx, blockhash);
+    }
+
+    /*
+     * The first two blocks of each lane.
+     */
+    for (lane = 0; lane < lanes; lane++) {
+        unsigned char bytes[ARGON2_BLOCK_SIZE];
+        int blk;
+
+        for (blk = 0; blk < 2; blk++) {
+            argon2_block_t * b = inst.ai_mem
+                + ((uint64_t)lane * inst.ai_lane_len) + blk;
+            int ix;
+
+            store32_le(blockhash + ARGON2_PREHASH_LEN,     (uint32_t)blk);
+            store32_le(blockhash + ARGON2_PREHASH_LEN + 4, lane);
+            argon2_hash_long(bytes, sizeof(bytes),
+                             blockhash, ARGON2_PREHASH_SEED_LEN);
+            for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK; ix++)
+                b->v[ix] = load64_le(bytes + (8 * ix));
+        }
+    }
+
+    argon2_fill_memory(&inst);
+
+    {
+        /*
+         * The final block is the xor of the last block of each lane.
+         */
+        argon2_block_t final;
+        unsigned char  bytes[ARGON2_BLOCK_SIZE];
+        int ix;
+
+        final = inst.ai_mem[inst.ai_lane_len - 1];
+        for (lane = 1; lane < lanes; lane++) {
+            argon2_block_t const * last = inst.ai_mem
+                + ((uint64_t)lane * inst.ai_lane_len) + inst.ai_lane_len - 1;
+            for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK; ix++)
+                final.v[ix] ^= last->v[ix];
+        }
+
+        for (ix = 0; ix < ARGON2_QWORDS_IN_BLOCK; ix++)
+            store64_le(bytes + (8 * ix), final.v[ix]);
+        argon2_hash_long(out, out_len, bytes, sizeof(bytes));
+        memset(bytes, 0, sizeof(bytes));
+        memset(&final, 0, sizeof(final));
+    }
+
+    memset(inst.ai_mem, 0, (size_t)inst.ai_blocks * sizeof(argon2_block_t));
+    free(inst.ai_mem);
+    memset(blockhash, 0, sizeof(blockhash));
+    return GC_OK;
+}
+
+/**
+ * Check both block compression implementations against the RFC 9106
+ * Argon2id test vector, and against each other for a multi-pass,
+ * multi-lane case with data dependent addressing.
+ *
+ * @returns true if all is well
+ */
+static bool
+argon2_self_test(void)
+{
+    static unsigned char const rfc_tag[32] = {
+        0x0d, 0x64, 0x0d, 0xf5, 0x8d, 0x78, 0x76, 0x6c,
+        0x08, 0xc0, 0x37, 0xa3, 0x4a, 0x8b, 0x53, 0xc9,
+        0xd0, 0x1e, 0xf0, 0x45, 0x2d, 0x75, 0xb6, 0x5e,
+        0xb5, 0x25, 0x20, 0xe9, 0x6b, 0x01, 0xe6, 0x59 };
+
+    unsigned char pw[32], salt[16], secret[8], ad[12];
+    unsigned char ref_out[sizeof(rfc_tag)];
+    unsigned char opt_out[sizeof(rfc_tag)];
+
+    memset(pw,     0x01, sizeof(pw));
+    memset(salt,   0x02, sizeof(salt));
+    memset(secret, 0x03, sizeof(secret));
+    memset(ad,     0x04, sizeof(ad));
+
+    if (argon2id_hash(ref_out, sizeof(ref_out), pw, sizeof(pw),
+                      salt, sizeof(salt), secret, sizeof(secret),
+                      ad, sizeof(ad), 3, 32, 4, 0, ARGON2_IMPL_REF) != GC_OK)
+        return false;
+
+    if (argon2id_hash(opt_out, sizeof(opt_out), pw, sizeof(pw),
+                      salt, sizeof(salt), secret, sizeof(secret),
+                      ad, sizeof(ad), 3, 32, 4, 0, ARGON2_IMPL_OPT) != GC_OK)
+        return false;
+
+    if (  (memcmp(ref_out, rfc_tag, sizeof(rfc_tag)) != 0)
+       || (memcmp(opt_out, rfc_tag, sizeof(rfc_tag)) != 0))
+        return false;
+
+    /*
+     * Cross check with a larger memory size, several passes and an
+     * odd lane count, filled by one thread and by several.
+     */
+    if (argon2id_hash(ref_out, sizeof(ref_out), pw, sizeof(pw),
+                      salt, sizeof(salt), NULL, 0, NULL, 0,
+                      4, 1024, 3, 1, ARGON2_IMPL_REF) != GC_OK)
+        return false;
+
+    if (argon2id_hash(opt_out, sizeof(opt_out), pw, sizeof(pw),
+                      salt, sizeof(salt), NULL, 0, NULL, 0,
+                      4, 1024, 3, 0, ARGON2_IMPL_OPT) != GC_OK)
+        return false;
+
+    return memcmp(ref_out, opt_out, sizeof(ref_out)) == 0;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of argon2.c */
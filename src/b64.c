@@ -0,0 +1,245 @@
+/**
+ * @file b64.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Base64 encoding of derived hashes.  The gnulib base64_encode() is
+ * always there and encodes whatever the vector code leaves.  On x86
+ * with GCC or clang, whole 3 byte groups are encoded 12 or 24 at a time
+ * with SSSE3 or AVX2, if the CPU has them.  The choice is made at run
+ * time, so one binary serves every CPU.  The output is always what
+ * base64_encode() would have written.
+ */
+
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ >= 5)))
+# define B64_X86 1
+# include <immintrin.h>
+#endif
+
+#define B64_SSSE3_IN    16  ///< bytes read for 12 encoded
+#define B64_SSSE3_OUT   16
+#define B64_AVX2_IN     28  ///< bytes read for 24 encoded
+#define B64_AVX2_OUT    32
+
+#ifdef B64_X86
+/*
+ * Each 32 bit lane gets three input bytes, arranged so that the four
+ * six bit indexes can be shifted into the four output bytes.  See
+ * "Faster Base64 Encoding and Decoding using AVX2 Instructions",
+ * Wojciech Mula and Daniel Lemire, 2018.
+ */
+# define B64_SPLIT      10, 11,  9, 10,  7,  8,  6,  7, \
+                         4,  5,  3,  4,  1,  2,  0,  1
+
+/*
+ * The index is turned into an offset table index:  0 for 'a'-'z',
+ * 1 - 10 for digits, 11 for '+', 12 for '/' and 13 for 'A'-'Z'.
+ * The offset is added to the index to get the character.
+ */
+# define B64_OFFSETS    0,   0, 'A', '/' - 63, '+' - 62,         \
+                        '0' - 52, '0' - 52, '0' - 52, '0' - 52,  \
+                        '0' - 52, '0' - 52, '0' - 52, '0' - 52,  \
+                        '0' - 52, '0' - 52, 'a' - 26
+#endif
+
+////LIB-HEADERS:
+
+#ifdef B64_X86
+/**
+ * Encode 12 bytes at a time with SSSE3.
+ *
+ * @returns the number of input bytes encoded, a multiple of 3
+ */
+__attribute__((target("ssse3")))
+PVT_static size_t
+b64_encode_ssse3(unsigned char const * in, size_t inlen,
+                 char * out, size_t outlen)
+{
+    __m128i const split = _mm_set_epi8(B64_SPLIT);
+    __m128i const offs  = _mm_set_epi8(B64_OFFSETS);
+    size_t        done  = 0;
+
+    while ((inlen >= B64_SSSE3_IN) && (outlen >= B64_SSSE3_OUT)) {
+        __m128i v = _mm_loadu_si128((__m128i const *)(void const *)in);
+        __m128i lo, hi, ix;
+
+        v  = _mm_shuffle_epi8(v, split);
+        lo = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0FC0FC00)),
+                             _mm_set1_epi32(0x04000040));
+        hi = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003F03F0)),
+                             _mm_set1_epi32(0x01000010));
+        v  = _mm_or_si128(lo, hi);
+
+        ix = _mm_subs_epu8(v, _mm_set1_epi8(51));
+        ix = _mm_or_si128(
+            ix, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), v),
+                              _mm_set1_epi8(13)));
+        v  = _mm_add_epi8(v, _mm_shuffle_epi8(offs, ix));
+        _mm_storeu_si128((__m128i *)(void *)out, v);
+
+        in     += 12; inlen  -= 12; done += 12;
+        out    += 16; outlen -= 16;
+    }
+
+    return done;
+}
+
+/**
+ * Encode 24 bytes at a time with AVX2, then 12 at a time with SSSE3.
+ *
+ * @returns the number of input bytes encoded, a multiple of 3
+ */
+__attribute__((target("avx2")))
+PVT_static size_t
+b64_encode_avx2(unsigned char const * in, size_t inlen,
+                char * out, size_t outlen)
+{
+    __m256i const split = _mm256_broadcastsi128_si256(_mm_set_epi8(B64_SPLIT));
+    __m256i const offs  =
+        _mm256_broadcastsi128_si256(_mm_set_epi8(B64_OFFSETS));
+    size_t        done  = 0;
+
+    while ((inlen >= B64_AVX2_IN) && (outlen >= B64_AVX2_OUT)) {
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128((__m128i const *)(void const *)in)),
+            _mm_loadu_si128((__m128i const *)(void const *)(in + 12)), 1);
+        __m256i lo, hi, ix;
+
+        v  = _mm256_shuffle_epi8(v, split);
+        lo = _mm256_mulhi_epu16(
+            _mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)),
+            _mm256_set1_epi32(0x04000040));
+        hi = _mm256_mullo_epi16(
+            _mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)),
+            _mm256_set1_epi32(0x01000010));
+        v  = _mm256_or_si256(lo, hi);
+
+        ix = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+        ix = _mm256_or_si256(
+            ix, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), v),
+                                 _mm256_set1_epi8(13)));
+        v  = _mm256_add_epi8(v, _mm256_shuffle_epi8(offs, ix));
+        _mm256_storeu_si256((__m256i *)(void *)out, v);
+
+        in     += 24; inlen  -= 24; done += 24;
+        out    += 32; outlen -= 32;
+    }
+
+    /*
+     * The SSSE3 code is not VEX encoded.  Clear the upper halves of the
+     * registers first, or each of its instructions pays for the switch.
+     */
+    _mm256_zeroupper();
+    return done + b64_encode_ssse3(in, inlen, out, outlen);
+}
+#endif // B64_X86
+
+/**
+ * @returns the best encoder the CPU can run.  The CPU is only probed
+ * on the first call:  that costs more than encoding a password.
+ */
+static b64_impl_t
+b64_best_impl(void)
+{
+#ifdef B64_X86
+    /*
+     * Threads that race to the first call all store the same answer,
+     * so relaxed atomics are enough.
+     */
+    static int best_impl = -1;
+    int        impl      = __atomic_load_n(&best_impl, __ATOMIC_RELAXED);
+
+    if (ISLIKELY(impl >= 0))
+        return (b64_impl_t)impl;
+
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        impl = B64_IMPL_AVX2;
+    else if (__builtin_cpu_supports("ssse3"))
+        impl = B64_IMPL_SSSE3;
+    else
+        impl = B64_IMPL_SCALAR;
+
+    __atomic_store_n(&best_impl, impl, __ATOMIC_RELAXED);
+    return (b64_impl_t)impl;
+#else
+    return B64_IMPL_SCALAR;
+#endif
+}
+
+/**
+ * Base64 encode with a particular encoder.  An encoder the CPU cannot
+ * run must not be asked for.  As with base64_encode(), as much as fits
+ * is written to \a out, with a NUL terminator if there is room for it.
+ *
+ * @param[in]  impl    the encoder
+ * @param[in]  in      the bytes to encode
+ * @param[in]  inlen   their count
+ * @param[out] out     the output buffer
+ * @param[in]  outlen  its size
+ */
+static void
+b64_encode_impl(b64_impl_t impl, char const * in, size_t inlen,
+                char * out, size_t outlen)
+{
+    size_t done = 0;
+
+    switch (impl) {
+#ifdef B64_X86
+    case B64_IMPL_AVX2:
+        done = b64_encode_avx2((unsigned char const *)in, inlen, out, outlen);
+        break;
+
+    case B64_IMPL_SSSE3:
+        done = b64_encode_ssse3((unsigned char const *)in, inlen, out, outlen);
+        break;
+#endif
+
+    default:
+        break;
+    }
+
+    /*
+     * "done" is a multiple of 3, so the rest starts on a group boundary.
+     */
+    base64_encode(in + done, inlen - done,
+                  out + (done / 3) * 4, outlen - (done / 3) * 4);
+}
+
+/**
+ * Base64 encode with the best encoder the CPU can run.
+ * The arguments and result are those of base64_encode().
+ */
+static void
+b64_encode(char const * in, size_t inlen, char * out, size_t outlen)
+{
+    b64_encode_impl(b64_best_impl(), in, inlen, out, outlen);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of b64.c */
@@ -210,6 +210,28 @@ sanity_check_cclass(void)
         DESC(CCLASS).optCookie = (void *)bits;
     } while (false);
 
+    do {
+        /*
+         * Triplets and sequences of specials are cleaned with the third
+         * special character.  If it is one of the other two, or one of
+         * the base64 characters those two replace, the fixups undo each
+         * other and never settle.
+         */
+        static uintptr_t const three_bits =
+            CCLASS_NO_TRIPLETS | CCLASS_NO_SEQUENCE;
+
+        char const * spec = OPT_ARG(SPECIALS);
+        uintptr_t    bits = OPT_VALUE_CCLASS;
+
+        if (  ((bits & three_bits) == 0) || (bits & CCLASS_NO_SPECIAL)
+           || (strlen(spec) != 3))
+            break;
+
+        if (  (spec[2] == spec[0]) || (spec[2] == spec[1])
+           || (spec[2] == '+')     || (spec[2] == '/'))
+            usage_message(specials_three, spec);
+    } while (false);
+
     if (OPT_VALUE_LENGTH < MIN_PW_LEN) {
         static uintptr_t const dig_only = CCLASS_NO_ALPHA | CCLASS_NO_SPECIAL;
         if ((OPT_VALUE_CCLASS & dig_only) != dig_only)
@@ -22,10 +22,228 @@
  *  with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * Each entry of the domain name file is one line:
+ *
+ *     <domain time=DAY>name</domain>
+ *
+ * where DAY is the day number of the last access, written with leading
+ * zeros as DOM_DAY_LEN digits.
+ */
+#define DOM_MARK        "<domain time="
+#define DOM_MARK_LEN    (sizeof(DOM_MARK) - 1)
+#define DOM_END_MARK    "</domain>"
+#define DOM_END_LEN     (sizeof(DOM_END_MARK) - 1)
+#define DOM_DAY_LEN     10
+#define DOM_NAME_MAX    244             ///< longer names are not recorded
+#define DOM_ENTRY_LEN(_l) \
+    (DOM_MARK_LEN + DOM_DAY_LEN + 1 + (_l) + DOM_END_LEN + 1)
+#define DOM_INDEX_MIN   256
+
+/*
+ * The match index is cached in a file next to the domain file.  It is
+ * used only if it was made from a domain file of the same size and
+ * modification time.
+ */
+#define DOM_KEY_SUFFIX  ".idx"
+#define DOM_KEY_MAGIC   0x47505749U     ///< "GPWI"
+
+typedef struct {
+    uint32_t    kh_magic;
+    uint32_t    kh_key_size;            ///< sizeof(dom_key_t)
+    uint64_t    kh_text_len;            ///< domain file size
+    int64_t     kh_mtime;               ///< domain file modification time
+    uint64_t    kh_ent_ct;              ///< count of indexed domains
+    uint64_t    kh_key_ct;              ///< count of keys that follow
+} dom_key_hdr_t;
+
 ////PULL-HEADERS:
 
 /**
- * load the domain file.
+ * Make room for \a add more bytes of domain text, plus a NUL byte.
+ * The buffer at least doubles each time it grows, so appending many
+ * domains costs linear time.
+ *
+ * @param add  the byte count to be appended
+ */
+static void
+dom_text_reserve(size_t add)
+{
+    size_t need = (size_t)dom_text_len + add + 1;
+    size_t sz;
+
+    if (need <= dom_text_size)
+        return;
+
+    sz = dom_text_size * 2;
+    if (sz < need)
+        sz = (need + 4095) & ~(size_t)4095;
+
+    dom_text = realloc(dom_text, sz);
+    if (dom_text == NULL)
+        nomem_err(sz, "domain names");
+    dom_text_size = sz;
+}
+
+/**
+ * Hash a domain name (32 bit FNV-1a).
+ */
+static size_t
+dom_hash_name(char const * name, size_t len)
+{
+    uint32_t res = 2166136261U;
+
+    while (len-- > 0) {
+        res ^= (unsigned char)*(name++);
+        res *= 16777619U;
+    }
+
+    return res;
+}
+
+/**
+ * Find the hash table slot for a domain name.
+ *
+ * @param name  the domain name
+ * @param len   its length
+ * @returns the slot holding its entry number, or else the empty slot
+ * where it belongs.  Entry numbers start at 1.
+ */
+static size_t *
+dom_hash_slot(char const * name, size_t len)
+{
+    size_t ix = dom_hash_name(name, len) & dom_hash_mask;
+
+    for (;;) {
+        size_t *          slot = dom_hash + ix;
+        dom_ent_t const * de;
+
+        if (*slot == 0)
+            return slot;
+
+        de = dom_ents + *slot - 1;
+        if (  (de->de_len == len)
+           && (memcmp(dom_text + de->de_name, name, len) == 0))
+            return slot;
+
+        ix = (ix + 1) & dom_hash_mask;
+    }
+}
+
+/**
+ * Double the size of the hash table (or make the first one) and enter
+ * every indexed domain again.
+ */
+static void
+dom_hash_grow(void)
+{
+    size_t ct = (dom_hash == NULL) ? DOM_INDEX_MIN : (dom_hash_mask + 1) * 2;
+    size_t ix;
+
+    free(dom_hash);
+    dom_hash = calloc(ct, sizeof(*dom_hash));
+    if (dom_hash == NULL)
+        nomem_err(ct * sizeof(*dom_hash), "domain index");
+    dom_hash_mask = ct - 1;
+
+    for (ix = 0; ix < dom_ent_ct; ix++) {
+        dom_ent_t const * de = dom_ents + ix;
+        *dom_hash_slot(dom_text + de->de_name, de->de_len) = ix + 1;
+    }
+}
+
+/**
+ * Find a domain in the index.
+ *
+ * @param name  the domain name
+ * @param len   its length
+ * @returns its entry, or NULL
+ */
+static dom_ent_t *
+dom_find(char const * name, size_t len)
+{
+    size_t * slot;
+
+    if (dom_hash == NULL)
+        return NULL;
+
+    slot = dom_hash_slot(name, len);
+    return (*slot == 0) ? NULL : (dom_ents + *slot - 1);
+}
+
+/**
+ * Add an entry of the domain text to the index.  If the domain is a
+ * duplicate, only its first entry is indexed.  The table is kept at
+ * most half full.
+ *
+ * @param off       offset of the entry
+ * @param name_off  offset of the domain name
+ * @param len       length of the domain name
+ */
+static void
+dom_index_add(size_t off, size_t name_off, size_t len)
+{
+    size_t *    slot;
+    dom_ent_t * de;
+
+    if ((dom_ent_ct + 1) * 2 > dom_hash_mask + 1)
+        dom_hash_grow();
+
+    slot = dom_hash_slot(dom_text + name_off, len);
+    if (*slot != 0)
+        return;
+
+    if (dom_ent_ct >= dom_ent_max) {
+        size_t sz;
+
+        dom_ent_max = (dom_ent_max == 0) ? DOM_INDEX_MIN : (dom_ent_max * 2);
+        sz = dom_ent_max * sizeof(*dom_ents);
+        dom_ents = realloc(dom_ents, sz);
+        if (dom_ents == NULL)
+            nomem_err(sz, "domain index");
+    }
+
+    de = dom_ents + dom_ent_ct;
+    de->de_off  = off;
+    de->de_name = name_off;
+    de->de_len  = len;
+    *slot = ++dom_ent_ct;
+}
+
+/**
+ * Index every entry of the domain text.  Lines that are not entries
+ * are left alone.
+ */
+static void
+dom_index_load(void)
+{
+    char const * scan    = dom_text;
+    char const * txt_end = dom_text + dom_text_len;
+
+    dom_ent_ct = 0;
+    if (dom_hash != NULL)
+        memset(dom_hash, 0, (dom_hash_mask + 1) * sizeof(*dom_hash));
+
+    while (scan < txt_end) {
+        char const * eol  = memchr(scan, '\n', (size_t)(txt_end - scan));
+        char const * name = scan + DOM_MARK_LEN + DOM_DAY_LEN + 1;
+
+        if (eol == NULL)
+            eol = txt_end;
+
+        if (  (name + DOM_END_LEN <= eol)
+           && (memcmp(scan, DOM_MARK, DOM_MARK_LEN) == 0)
+           && (name[-1] == '>')
+           && (memcmp(eol - DOM_END_LEN, DOM_END_MARK, DOM_END_LEN) == 0))
+            dom_index_add((size_t)(scan - dom_text), (size_t)(name - dom_text),
+                          (size_t)((eol - DOM_END_LEN) - name));
+
+        scan = eol + 1;
+    }
+}
+
+/**
+ * load the domain file and index its entries.
  * The buffer allocated for it is big enough for all the text,
  * plus a NUL byte then rounded up to a multiple of 4096.
  *
@@ -36,16 +254,22 @@ load_domain_file(char const * fname)
 {
     char * txt;
     char * scn;
-    size_t sz;
+    off_t  rem;
     FILE * fp;
 
+    dom_text_len  = 0;
+    dom_text_size = 0;
+    dom_rewrite   = false;
+    dom_dirty_lo  = dom_dirty_hi = 0;
+
     if (stat(fname, &dom_file_stat) != 0) {
         if (errno != ENOENT)
             fserr(GNU_PW_MGR_EXIT_INVALID, "stat", fname);
-        dom_file_stat.st_size = 4096;
-        txt = malloc(dom_file_stat.st_size);
-        txt[0] = NUL;
-        return txt;
+        dom_text = NULL;
+        dom_text_reserve(0);
+        dom_text[0] = NUL;
+        dom_index_load();
+        return dom_text;
     }
 
     if (! S_ISREG(dom_file_stat.st_mode)) {
@@ -55,22 +279,20 @@ load_domain_file(char const * fname)
     fp  = fopen(fname, "r");
     if (fp == NULL)
         fserr(GNU_PW_MGR_EXIT_INVALID, "fopen 'r'", fname);
-    sz  = (dom_file_stat.st_size + 4096) & ~4096;
-    txt = scn = malloc(sz);
-    for (;;) {
-        size_t rdsz = fread(scn, 1, dom_file_stat.st_size, fp);
+    dom_text = NULL;
+    dom_text_reserve((size_t)dom_file_stat.st_size);
+    txt = scn = dom_text;
+    for (rem = dom_file_stat.st_size; rem > 0;) {
+        size_t rdsz = fread(scn, 1, (size_t)rem, fp);
         if (rdsz == 0)
             break;
         scn += rdsz;
-        dom_file_stat.st_size -= rdsz;
-        if (dom_file_stat.st_size == 0)
-            break;
+        rem -= rdsz;
     }
     *scn = NUL;
-    dom_file_stat.st_size = sz;
-    dom_text_len          = (scn - txt);
-    dom_text = txt;
+    dom_text_len = (scn - txt);
     fclose(fp);
+    dom_index_load();
     return txt;
 }
 
@@ -86,14 +308,65 @@ list_domains(void)
 }
 
 /**
- * List the domains in the domain file.
+ * Write only the changed access dates into the domain file, with one
+ * pwrite() of the bytes from the first to the last of them.  The file
+ * must still be the one that was loaded.
+ *
+ * @returns false if the whole file must be written instead
+ */
+static bool
+write_dom_days(void)
+{
+    struct stat sb;
+    char const * scan = dom_text + dom_dirty_lo;
+    size_t       len  = dom_dirty_hi - dom_dirty_lo;
+    off_t        off  = (off_t)dom_dirty_lo;
+    int          fd   = open(dom_file_name, O_WRONLY);
+
+    if (fd < 0)
+        return false;
+
+    if (  (fstat(fd, &sb) != 0)
+       || (sb.st_size  != dom_text_len)
+       || (sb.st_mtime != dom_file_stat.st_mtime)) {
+        close(fd);
+        return false;
+    }
+
+    while (len > 0) {
+        ssize_t ct = pwrite(fd, scan, len, off);
+        if (ct <= 0) {
+            if ((ct < 0) && (errno == EINTR))
+                continue;
+            close(fd);
+            return false;
+        }
+        scan += ct;
+        off  += ct;
+        len  -= (size_t)ct;
+    }
+
+    if (close(fd) != 0)
+        return false;
+    (void) stat(dom_file_name, &dom_file_stat);
+    return true;
+}
+
+/**
+ * Write out the domain file.  If only access dates of known domains
+ * have changed, only they are written.
  */
 static void
 write_dom_file(void)
 {
     FILE * fp;
-    if (dom_text_len == 0)
-        return;
+
+    if (! dom_rewrite) {
+        if (dom_dirty_hi == dom_dirty_lo)
+            return;
+        if (write_dom_days())
+            return;
+    }
 
     fp = fopen(dom_file_name, "w");
     if (fp == NULL)
@@ -102,6 +375,13 @@ write_dom_file(void)
     if (wrlen != dom_text_len)
         fserr(GNU_PW_MGR_EXIT_INVALID, "fwrite", dom_file_name);
     fclose(fp);
+
+    /*
+     * The match index cache records the new modification time.
+     */
+    (void) stat(dom_file_name, &dom_file_stat);
+    dom_rewrite  = false;
+    dom_dirty_lo = dom_dirty_hi = 0;
 }
 
 /**
@@ -112,50 +392,557 @@ write_dom_file(void)
 static void
 insert_domain(char const * dom)
 {
-    static char const end_dom_mark[]  = "</domain>\n";
-    static char const dom_entry_fmt[] = "<domain time=%-10.10lu%s";
-    static unsigned long const secs_per_day = 60UL * 60UL * 24UL;
-    static size_t base_size = sizeof(end_dom_mark) + sizeof(dom_entry_fmt);
+    size_t        dom_len  = strlen(dom);
+    unsigned long cap_time = (unsigned long)time(NULL) / SECONDS_IN_DAY;
+    dom_ent_t *   de;
+    int           ct;
 
-    char buf[256] = ">";
-    size_t dom_len = strlen(dom);
-    unsigned long cap_time = (unsigned long)time(NULL) / secs_per_day;
-    if (dom_len + sizeof(end_dom_mark) + 1 > sizeof(buf))
+    if (dom_len > DOM_NAME_MAX)
         return;
 
     if (dom_text == NULL)
         (void) load_domain_file(dom_file_name);
-    memcpy(buf+1, dom, dom_len);
-    memcpy(buf + 1 + dom_len, end_dom_mark, sizeof(end_dom_mark));
 
-    char * dom_entry = strstr(dom_text, buf);
+    de = dom_find(dom, dom_len);
 
     /*
-     * IF we have this domain already, then
+     * IF we have this domain already, then update its date.
+     * Note the changed bytes, so they alone can be written.
      */
-    if (dom_entry != NULL) {
-        dom_entry -= 10;
-        int ct = sprintf(dom_entry, "%-10.10lu", cap_time);
-        assert(ct == 10);
-        dom_entry[10] = '>';
-
-    } else {
-        if ((dom_text_len + dom_len + base_size) >= dom_file_stat.st_size) {
-            dom_file_stat.st_size += 4096;
-            dom_text = realloc(dom_text, dom_file_stat.st_size);
-            if (dom_text == NULL) {
-                sprintf(buf, "%lu", (unsigned long) dom_file_stat.st_size);
-                fserr(GNU_PW_MGR_EXIT_NO_MEM, "realloc", buf);
+    if (de != NULL) {
+        size_t off = de->de_off + DOM_MARK_LEN;
+        char   day[DOM_DAY_LEN + 1];
+
+        ct = snprintf(day, sizeof(day), "%-10.10lu", cap_time);
+        assert(ct == DOM_DAY_LEN);
+        if (memcmp(dom_text + off, day, DOM_DAY_LEN) == 0)
+            return;
+        memcpy(dom_text + off, day, DOM_DAY_LEN);
+
+        if (dom_dirty_hi == dom_dirty_lo) {
+            dom_dirty_lo = off;
+            dom_dirty_hi = off + DOM_DAY_LEN;
+        } else {
+            if (off < dom_dirty_lo)
+                dom_dirty_lo = off;
+            if (off + DOM_DAY_LEN > dom_dirty_hi)
+                dom_dirty_hi = off + DOM_DAY_LEN;
+        }
+        return;
+    }
+
+    dom_rewrite = true;
+    free(dom_keys);
+    dom_keys = NULL;
+    dom_text_reserve(DOM_ENTRY_LEN(dom_len));
+    ct = sprintf(dom_text + dom_text_len,
+                 DOM_MARK "%-10.10lu>%s" DOM_END_MARK "\n", cap_time, dom);
+    assert((size_t)ct == DOM_ENTRY_LEN(dom_len));
+    dom_index_add((size_t)dom_text_len,
+                  (size_t)dom_text_len + DOM_MARK_LEN + DOM_DAY_LEN + 1,
+                  dom_len);
+    dom_text_len += ct;
+}
+
+/**
+ * Add every domain listed in a file, one per line.  Blank lines and
+ * lines starting with a hash mark are skipped, and so are names too
+ * long to be recorded.
+ *
+ * @param fname  the name of the list file
+ * @returns true if any domain was listed
+ */
+static bool
+import_domains(char const * fname)
+{
+    char   buf[DOM_NAME_MAX + 8];
+    bool   in_long = false;
+    bool   res     = false;
+    FILE * fp      = fopen(fname, "r");
+
+    if (fp == NULL)
+        fserr(GNU_PW_MGR_EXIT_INVALID, "fopen 'r'", fname);
+
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        size_t len     = strlen(buf);
+        bool   at_eol  = (len > 0) && (buf[len - 1] == '\n');
+        char * dom;
+
+        /*
+         * Skip the rest of a line too long for the buffer.
+         */
+        if (in_long || (! at_eol && ! feof(fp))) {
+            in_long = ! at_eol;
+            continue;
+        }
+
+        dom = trim(buf);
+        if ((*dom == NUL) || (*dom == '#'))
+            continue;
+
+        insert_domain(dom);
+        res = true;
+    }
+
+    if (ferror(fp))
+        fserr(GNU_PW_MGR_EXIT_INVALID, "fread", fname);
+    fclose(fp);
+    return res;
+}
+
+/**
+ * @returns the access day of a domain entry.
+ */
+static unsigned long
+dom_day(dom_ent_t const * de)
+{
+    return strtoul(dom_text + de->de_off + DOM_MARK_LEN, NULL, 10);
+}
+
+/**
+ * @returns the length of a match index key.
+ */
+static size_t
+dom_key_len(dom_key_t const * key)
+{
+    dom_ent_t const * de = dom_ents + key->dk_ent;
+    return de->de_name + de->de_len - key->dk_off;
+}
+
+/**
+ * Compare the text of a match index key with a string.  Only the first
+ * \a len bytes of the key are compared, if the key is longer.
+ *
+ * @param key  the index key
+ * @param str  the string
+ * @param len  its length
+ * @returns less than, equal to or greater than zero
+ */
+static int
+dom_key_strcmp(dom_key_t const * key, char const * str, size_t len)
+{
+    size_t klen = dom_key_len(key);
+    int    res  = memcmp(dom_text + key->dk_off, str, (klen < len) ? klen : len);
+
+    if ((res != 0) || (klen >= len))
+        return res;
+    return -1;
+}
+
+/**
+ * qsort comparison for match index keys:  by key text.
+ */
+static int
+dom_key_cmp(void const * l, void const * r)
+{
+    size_t len = dom_key_len(r);
+    int    res = dom_key_strcmp(l, dom_text + ((dom_key_t const *)r)->dk_off,
+                                len);
+
+    if (res != 0)
+        return res;
+    return (dom_key_len(l) > len) ? 1 : 0;
+}
+
+/**
+ * Make the match index.  There is a key for each domain name and for
+ * the part of each name after each of its dots, sorted by key text.
+ */
+static void
+dom_keys_build(void)
+{
+    size_t ct = dom_ent_ct;
+    size_t ix;
+
+    for (ix = 0; ix < dom_ent_ct; ix++) {
+        dom_ent_t const * de  = dom_ents + ix;
+        char const *      nm  = dom_text + de->de_name;
+        char const *      end = nm + de->de_len;
+
+        while ((nm = memchr(nm, '.', (size_t)(end - nm))) != NULL) {
+            nm++;
+            ct++;
+        }
+    }
+
+    free(dom_keys);
+    dom_keys = malloc((ct + 1) * sizeof(*dom_keys));
+    if (dom_keys == NULL)
+        nomem_err((ct + 1) * sizeof(*dom_keys), "domain match index");
+    dom_key_ct = 0;
+
+    for (ix = 0; ix < dom_ent_ct; ix++) {
+        dom_ent_t const * de  = dom_ents + ix;
+        char const *      nm  = dom_text + de->de_name;
+        char const *      end = nm + de->de_len;
+
+        for (;;) {
+            char const * dot = memchr(nm, '.', (size_t)(end - nm));
+
+            dom_keys[dom_key_ct].dk_off = (size_t)(nm - dom_text);
+            dom_keys[dom_key_ct].dk_ent = ix;
+            dom_key_ct++;
+            if (dot == NULL)
+                break;
+            nm = dot + 1;
+        }
+    }
+
+    qsort(dom_keys, dom_key_ct, sizeof(*dom_keys), dom_key_cmp);
+}
+
+/**
+ * Load the cached match index.  Every key is checked, so a damaged
+ * or out of date cache is only ignored.
+ *
+ * @param fname  the name of the cache file
+ * @returns true if it is good
+ */
+static bool
+dom_keys_load(char const * fname)
+{
+    dom_key_hdr_t hdr;
+    size_t        ix;
+    size_t        sz;
+    FILE *        fp = fopen(fname, "r");
+
+    if (fp == NULL)
+        return false;
+
+    if (  (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+       || (hdr.kh_magic    != DOM_KEY_MAGIC)
+       || (hdr.kh_key_size != sizeof(dom_key_t))
+       || (hdr.kh_text_len != (uint64_t)dom_text_len)
+       || (hdr.kh_mtime    != (int64_t)dom_file_stat.st_mtime)
+       || (hdr.kh_ent_ct   != dom_ent_ct)
+       || (hdr.kh_key_ct   <  dom_ent_ct)
+       || (hdr.kh_key_ct   >  (uint64_t)dom_text_len)) {
+        fclose(fp);
+        return false;
+    }
+
+    sz = (size_t)hdr.kh_key_ct * sizeof(*dom_keys);
+    free(dom_keys);
+    dom_keys = malloc(sz + sizeof(*dom_keys));
+    if (dom_keys == NULL)
+        nomem_err(sz, "domain match index");
+    dom_key_ct = (size_t)hdr.kh_key_ct;
+    ix = fread(dom_keys, sizeof(*dom_keys), dom_key_ct, fp);
+    fclose(fp);
+    if (ix != dom_key_ct)
+        return false;
+
+    for (ix = 0; ix < dom_key_ct; ix++) {
+        dom_key_t const * key = dom_keys + ix;
+        dom_ent_t const * de;
+
+        if (key->dk_ent >= dom_ent_ct)
+            return false;
+        de = dom_ents + key->dk_ent;
+        if (  (key->dk_off < de->de_name)
+           || (key->dk_off > de->de_name + de->de_len)
+           || ((key->dk_off > de->de_name) && (dom_text[key->dk_off - 1] != '.'))
+           || ((ix > 0) && (dom_key_cmp(key - 1, key) > 0)))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Save the match index in its cache file.  Failing to is not an error.
+ *
+ * @param fname  the name of the cache file
+ */
+static void
+dom_keys_save(char const * fname)
+{
+    dom_key_hdr_t hdr = {
+        .kh_magic    = DOM_KEY_MAGIC,
+        .kh_key_size = sizeof(dom_key_t),
+        .kh_text_len = (uint64_t)dom_text_len,
+        .kh_mtime    = (int64_t)dom_file_stat.st_mtime,
+        .kh_ent_ct   = dom_ent_ct,
+        .kh_key_ct   = dom_key_ct
+    };
+    int    fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    FILE * fp;
+
+    if (fd < 0)
+        return;
+    fp = fdopen(fd, "w");
+    if (fp == NULL) {
+        close(fd);
+        return;
+    }
+
+    if (  (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+       || (fwrite(dom_keys, sizeof(*dom_keys), dom_key_ct, fp) != dom_key_ct)
+       || (fclose(fp) != 0))
+        (void) unlink(fname);
+}
+
+/**
+ * Get the match index, from its cache file if that is up to date.
+ * Otherwise it is made and cached.  The domain file must be loaded.
+ */
+static void
+dom_keys_get(void)
+{
+    size_t len   = strlen(dom_file_name);
+    char * fname = malloc(len + sizeof(DOM_KEY_SUFFIX));
+
+    if (fname == NULL)
+        nomem_err(len + sizeof(DOM_KEY_SUFFIX), "index file name");
+    memcpy(fname, dom_file_name, len);
+    memcpy(fname + len, DOM_KEY_SUFFIX, sizeof(DOM_KEY_SUFFIX));
+
+    if (! dom_keys_load(fname)) {
+        dom_keys_build();
+        if (dom_text_len > 0)
+            dom_keys_save(fname);
+    }
+
+    free(fname);
+}
+
+/**
+ * qsort comparison for matched domains:  most recently accessed first,
+ * then by entry.  A domain matched more than once sorts together.
+ */
+static int
+dom_match_cmp(void const * l, void const * r)
+{
+    dom_match_t const * lm = l;
+    dom_match_t const * rm = r;
+
+    if (lm->dm_day != rm->dm_day)
+        return (lm->dm_day > rm->dm_day) ? -1 : 1;
+    if (lm->dm_ent != rm->dm_ent)
+        return (lm->dm_ent->de_name < rm->dm_ent->de_name) ? -1 : 1;
+    return 0;
+}
+
+/**
+ * Print the domains with a name, or a part of a name following a dot,
+ * that starts with \a text.  The most recently used come first.
+ * The keys that match are found with a binary search of the index.
+ *
+ * @param text  the start of the domain names wanted
+ */
+static void
+match_domains(char const * text)
+{
+    size_t        len = strlen(text);
+    size_t        lo  = 0;
+    size_t        hi;
+    size_t        ix;
+    size_t        ct;
+    dom_match_t * hits;
+
+    if (dom_keys == NULL)
+        dom_keys_get();
+
+    for (hi = dom_key_ct; lo < hi;) {
+        size_t md = lo + (hi - lo) / 2;
+        if (dom_key_strcmp(dom_keys + md, text, len) < 0)
+            lo = md + 1;
+        else
+            hi = md;
+    }
+
+    for (hi = lo; hi < dom_key_ct; hi++)
+        if (dom_key_strcmp(dom_keys + hi, text, len) != 0)
+            break;
+    if (hi == lo)
+        return;
+
+    hits = malloc((hi - lo) * sizeof(*hits));
+    if (hits == NULL)
+        nomem_err((hi - lo) * sizeof(*hits), "domain matches");
+
+    for (ix = lo, ct = 0; ix < hi; ix++, ct++) {
+        hits[ct].dm_ent = dom_ents + dom_keys[ix].dk_ent;
+        hits[ct].dm_day = dom_day(hits[ct].dm_ent);
+    }
+    qsort(hits, ct, sizeof(*hits), dom_match_cmp);
+
+    for (ix = 0; ix < ct; ix++) {
+        dom_ent_t const * de = hits[ix].dm_ent;
+
+        if ((ix > 0) && (hits[ix - 1].dm_ent == de))
+            continue;
+        fwrite(dom_text + de->de_name, 1, de->de_len, stdout);
+        putc('\n', stdout);
+    }
+
+    free(hits);
+}
+
+/**
+ * Move a heap entry down to its place.  The heap root is the least
+ * recently used of the domains in it.
+ *
+ * @param heap  the heap
+ * @param ct    its entry count
+ * @param ix    the entry to move
+ */
+static void
+dom_heap_down(dom_match_t * heap, size_t ct, size_t ix)
+{
+    for (;;) {
+        size_t      lo = ix;
+        size_t      ch = 2 * ix + 1;
+        dom_match_t tmp;
+
+        if ((ch < ct) && (dom_match_cmp(heap + ch, heap + lo) > 0))
+            lo = ch;
+        if ((ch + 1 < ct) && (dom_match_cmp(heap + ch + 1, heap + lo) > 0))
+            lo = ch + 1;
+        if (lo == ix)
+            return;
+
+        tmp = heap[ix]; heap[ix] = heap[lo]; heap[lo] = tmp;
+        ix  = lo;
+    }
+}
+
+/**
+ * Print the entries of the \a max_ct most recently used domains, most
+ * recent first.  One pass over the index keeps the best ones seen so
+ * far in a heap of \a max_ct entries, so only those are ever sorted.
+ *
+ * @param max_ct  the count of domains wanted
+ */
+static void
+recent_domains(size_t max_ct)
+{
+    dom_match_t * heap;
+    size_t        ct = 0;
+    size_t        ix;
+
+    if (max_ct > dom_ent_ct)
+        max_ct = dom_ent_ct;
+    if (max_ct == 0)
+        return;
+
+    heap = malloc(max_ct * sizeof(*heap));
+    if (heap == NULL)
+        nomem_err(max_ct * sizeof(*heap), "domain list");
+
+    for (ix = 0; ix < dom_ent_ct; ix++) {
+        dom_match_t dm = { .dm_day = dom_day(dom_ents + ix),
+                           .dm_ent = dom_ents + ix };
+
+        if (ct < max_ct) {
+            size_t hx = ct++;
+
+            /*
+             * Sift the new entry up.
+             */
+            while (hx > 0) {
+                size_t up = (hx - 1) / 2;
+                if (dom_match_cmp(&dm, heap + up) <= 0)
+                    break;
+                heap[hx] = heap[up];
+                hx = up;
             }
+            heap[hx] = dm;
+
+        } else if (dom_match_cmp(&dm, heap) < 0) {
+            heap[0] = dm;
+            dom_heap_down(heap, ct, 0);
         }
-        dom_entry = dom_text + dom_text_len;
-        dom_text_len += sprintf(dom_entry, dom_entry_fmt, cap_time, buf);
     }
+
+    /*
+     * The last entry in the file may have no newline, so supply them all.
+     */
+    qsort(heap, ct, sizeof(*heap), dom_match_cmp);
+    for (ix = 0; ix < ct; ix++) {
+        dom_ent_t const * de  = heap[ix].dm_ent;
+        size_t            len = DOM_ENTRY_LEN(de->de_len);
+
+        fwrite(dom_text + de->de_off, 1, len - 1, stdout);
+        putc(NL, stdout);
+    }
+
+    free(heap);
+}
+
+/**
+ * Rewrite the domain text with only the domains used in the last
+ * \a days days, and at most \a max_ct of them.  The most recently used
+ * come first.  Lines that are not domain entries are dropped, and so
+ * are repeated entries for a domain.
+ *
+ * @param days    the age limit, or -1 for none
+ * @param max_ct  the count limit, or 0 for none
+ */
+static void
+prune_domains(long days, size_t max_ct)
+{
+    unsigned long today = (unsigned long)time(NULL) / SECONDS_IN_DAY;
+    dom_match_t * keep  = malloc((dom_ent_ct + 1) * sizeof(*keep));
+    size_t        ct    = 0;
+    size_t        ix;
+    char *        txt;
+    char *        scan;
+
+    if (keep == NULL)
+        nomem_err((dom_ent_ct + 1) * sizeof(*keep), "domain list");
+
+    for (ix = 0; ix < dom_ent_ct; ix++) {
+        dom_ent_t const * de  = dom_ents + ix;
+        unsigned long     day = dom_day(de);
+
+        if ((days >= 0) && (day + (unsigned long)days < today))
+            continue;
+        keep[ct].dm_ent = de;
+        keep[ct].dm_day = day;
+        ct++;
+    }
+
+    qsort(keep, ct, sizeof(*keep), dom_match_cmp);
+    if ((max_ct > 0) && (ct > max_ct))
+        ct = max_ct;
+
+    /*
+     * The kept entries are no longer than the whole text, plus the
+     * newline the last entry may be missing.
+     */
+    dom_text_reserve(1);
+    scan = txt = malloc(dom_text_size);
+    if (txt == NULL)
+        nomem_err(dom_text_size, "domain names");
+
+    for (ix = 0; ix < ct; ix++) {
+        dom_ent_t const * de  = keep[ix].dm_ent;
+        size_t            len = DOM_ENTRY_LEN(de->de_len);
+
+        memcpy(scan, dom_text + de->de_off, len - 1);
+        scan[len - 1] = NL;
+        scan += len;
+    }
+    *scan = NUL;
+
+    free(keep);
+    free(dom_text);
+    free(dom_keys);
+    dom_rewrite  = true;
+    dom_keys     = NULL;
+    dom_text     = txt;
+    dom_text_len = scan - txt;
+    dom_index_load();
 }
 
 /**
  * Figure out the name of the domain name file.
- * See find_cfg_name() above.
+ * See find_cfg_name() above.  With a \a --config-file option, the
+ * domain name file is in the same directory as the config file.
+ * Domain entries must not be put in the config file:  they would be
+ * taken for \a --domain options when it gets loaded.  Older versions
+ * did put them there.  See move_cfg_domains().
  *
  * @returns  the name in a scribble buffer.  Copy it out to save it.
  */
@@ -163,8 +950,12 @@ static char *
 find_dom_file(void)
 {
     if (HAVE_OPT(CONFIG_FILE)) {
-        (void)set_cfg_dir(NULL);
-        return strdup(OPT_ARG(CONFIG_FILE));
+        char * fname     = set_cfg_dir(NULL);
+        size_t fname_len = strlen(fname);
+
+        fname[fname_len++] = '/';
+        strcpy(fname + fname_len, local_dom);
+        return fname;
     }
 
     {
@@ -178,36 +969,209 @@ find_dom_file(void)
 }
 
 /**
- * Process domain name option.
+ * Remember the name of a domain entry moved out of the config file.
+ *
+ * @param name  the domain name
+ * @param len   its length
+ */
+static void
+add_moved_dom(char const * name, size_t len)
+{
+    char * nm = malloc(len + 1);
+    size_t sz = (dom_moved_ct + 1) * sizeof(*dom_moved);
+
+    dom_moved = realloc(dom_moved, sz);
+    if ((nm == NULL) || (dom_moved == NULL))
+        nomem_err(sz + len + 1, "moved domain names");
+    memcpy(nm, name, len);
+    nm[len] = NUL;
+    dom_moved[dom_moved_ct++] = nm;
+}
+
+/**
+ * Domain entries used to be kept in the config file itself when the
+ * \a --config-file option was used.  Move any that are still there into
+ * the domain file and take them out of the config file.  For a domain
+ * that is in both, the later access date is kept.  The names moved are
+ * kept in \a dom_moved, in config file order.
+ */
+static void
+move_cfg_domains(void)
+{
+    struct stat  sb;
+    char *       scan;
+    char *       keep;
+    char const * txt_end;
+
+    if (stat(OPT_ARG(CONFIG_FILE), &sb) != 0)
+        return;
+
+    if (config_file_name == NULL)
+        set_config_name(OPT_ARG(CONFIG_FILE));
+    load_config_file();
+    if (strstr(config_file_text, DOM_MARK) == NULL) {
+        secure_cfg_file();
+        return;
+    }
+
+    scan    = keep = config_file_text;
+    txt_end = scan + strlen(scan);
+
+    while (scan < txt_end) {
+        char * eol  = memchr(scan, NL, (size_t)(txt_end - scan));
+        char * next = (eol == NULL) ? (char *)txt_end : (eol + 1);
+        char * name = scan + DOM_MARK_LEN + DOM_DAY_LEN + 1;
+        size_t len;
+
+        if (eol == NULL)
+            eol = (char *)txt_end;
+
+        if (  (name + DOM_END_LEN > eol)
+           || (memcmp(scan, DOM_MARK, DOM_MARK_LEN) != 0)
+           || (name[-1] != '>')
+           || (memcmp(eol - DOM_END_LEN, DOM_END_MARK, DOM_END_LEN) != 0)) {
+            memmove(keep, scan, (size_t)(next - scan));
+            keep += next - scan;
+            scan  = next;
+            continue;
+        }
+
+        len = (size_t)((eol - DOM_END_LEN) - name);
+        if ((len > 0) && (len <= DOM_NAME_MAX)) {
+            dom_ent_t * de = dom_find(name, len);
+
+            if (de == NULL) {
+                size_t ent_len = DOM_ENTRY_LEN(len);
+
+                free(dom_keys);
+                dom_keys = NULL;
+                dom_text_reserve(ent_len);
+                memcpy(dom_text + dom_text_len, scan, ent_len - 1);
+                dom_text[dom_text_len + ent_len - 1] = NL;
+                dom_index_add((size_t)dom_text_len,
+                              (size_t)dom_text_len + (size_t)(name - scan),
+                              len);
+                dom_text_len += ent_len;
+                dom_text[dom_text_len] = NUL;
+
+            } else {
+                /*
+                 * The days have leading zeros, so they compare as text.
+                 */
+                char * day = dom_text + de->de_off + DOM_MARK_LEN;
+                if (memcmp(scan + DOM_MARK_LEN, day, DOM_DAY_LEN) > 0)
+                    memcpy(day, scan + DOM_MARK_LEN, DOM_DAY_LEN);
+            }
+
+            add_moved_dom(name, len);
+        }
+
+        scan = next;
+    }
+    *keep = NUL;
+
+    /*
+     * Write the domain file first, so no entry is ever in neither file.
+     * It is written whole:  this happens only once.
+     */
+    dom_rewrite = true;
+    write_dom_file();
+
+    {
+        FILE * fp = fopen(config_file_name, "w");
+        if (fp == NULL)
+            fserr(GNU_PW_MGR_EXIT_NO_CONFIG, fopen_z, config_file_name);
+        fputs(config_file_text, fp);
+        if (fclose(fp) != 0)
+            fserr(GNU_PW_MGR_EXIT_NO_CONFIG, fclose_z, config_file_name);
+    }
+
+    secure_cfg_file();
+    fprintf(stderr, dom_moved_fmt, (unsigned int)dom_moved_ct,
+            config_file_name, dom_file_name);
+}
+
+/**
+ * Find and load the domain name file.  With a \a --config-file option,
+ * domain entries still in the config file are moved into it first.
+ */
+static void
+open_dom_file(void)
+{
+    dom_file_name = find_dom_file();
+    (void) load_domain_file(dom_file_name);
+    if (HAVE_OPT(CONFIG_FILE))
+        move_cfg_domains();
+}
+
+/**
+ * @returns true if any option that works on the domain file was given.
+ */
+static bool
+have_dom_opts(void)
+{
+    return HAVE_OPT(DOMAIN) || HAVE_OPT(DOMAIN_IMPORT)
+        || HAVE_OPT(DOMAIN_MATCH) || HAVE_OPT(DOMAIN_PRUNE)
+        || HAVE_OPT(DOMAIN_MAX) || HAVE_OPT(DOMAIN_RECENT);
+}
+
+/**
+ * Process domain name option.  The config file was loaded as an options
+ * file, so any domain entries still in it are at the front of the
+ * \a --domain list.  Those were just moved and are not used here.
  */
 static void
 proc_dom_opts(int rem_arg_ct)
 {
-    int  ct = STACKCT_OPT(DOMAIN);
-    char const ** dom_list = STACKLST_OPT(DOMAIN);
     bool list_doms = false;
     bool new_entry = false;
+    bool dom_work  = HAVE_OPT(DOMAIN_IMPORT) || HAVE_OPT(DOMAIN_MATCH)
+        || HAVE_OPT(DOMAIN_PRUNE) || HAVE_OPT(DOMAIN_MAX)
+        || HAVE_OPT(DOMAIN_RECENT);
 
-    dom_file_name = find_dom_file();
-    dom_text = load_domain_file(dom_file_name);
+    open_dom_file();
+
+    if (HAVE_OPT(DOMAIN_IMPORT))
+        new_entry = import_domains(OPT_ARG(DOMAIN_IMPORT));
+
+    if (HAVE_OPT(DOMAIN)) {
+        int  ct = STACKCT_OPT(DOMAIN);
+        char const ** dom_list = STACKLST_OPT(DOMAIN);
+        size_t ix;
 
-    do {
-        char const * dom = *(dom_list++);
-        if ((*dom == '-') && (dom[1] == NUL))
-            list_doms = true;
+        for (ix = 0; (ix < dom_moved_ct) && (ct > 0); ix++, ct--, dom_list++)
+            if (strcmp(*dom_list, dom_moved[ix]) != 0)
+                break;
 
-        else {
-            insert_domain(dom);
-            new_entry = true;
+        for (; ct > 0; ct--) {
+            char const * dom = *(dom_list++);
+            dom_work = true;
+            if ((*dom == '-') && (dom[1] == NUL))
+                list_doms = true;
+
+            else {
+                insert_domain(dom);
+                new_entry = true;
+            }
         }
-    } while (--ct > 0);
+    }
+
+    if (HAVE_OPT(DOMAIN_PRUNE) || HAVE_OPT(DOMAIN_MAX)) {
+        prune_domains(HAVE_OPT(DOMAIN_PRUNE) ? OPT_VALUE_DOMAIN_PRUNE : -1,
+                      HAVE_OPT(DOMAIN_MAX)   ? OPT_VALUE_DOMAIN_MAX   : 0);
+        new_entry = true;
+    }
 
     if (new_entry)
         write_dom_file();
 
     if (list_doms)
         list_domains();
-    if (rem_arg_ct <= 0)
+    if (HAVE_OPT(DOMAIN_MATCH))
+        match_domains(OPT_ARG(DOMAIN_MATCH));
+    if (HAVE_OPT(DOMAIN_RECENT))
+        recent_domains((size_t)OPT_VALUE_DOMAIN_RECENT);
+    if ((rem_arg_ct <= 0) && dom_work)
         exit(GNU_PW_MGR_EXIT_SUCCESS);
 }
 
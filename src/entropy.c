@@ -0,0 +1,188 @@
+/**
+ * @file entropy.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Random bytes for seed text.  They come from getrandom(), where there is
+ * one, or else from the random device.  There is no fallback to the time
+ * of day:  without a source of randomness, the program exits.
+ */
+
+#ifdef HAVE_SYS_RANDOM_H
+# include <sys/random.h>
+#endif
+
+/*
+ * The printable ASCII characters, space through tilde.
+ */
+static char const entropy_print_chars[] =
+    " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`"
+    "abcdefghijklmnopqrstuvwxyz{|}~";
+
+/*
+ * The same, without space, quotes, backquote, dollar sign or backslash.
+ * Text made of these needs nothing more than quotes around it on a
+ * shell command line.
+ */
+static char const entropy_shell_chars[] =
+    "!#%&()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[]^_"
+    "abcdefghijklmnopqrstuvwxyz{|}~";
+
+////PULL-HEADERS:
+
+/**
+ * Read random bytes from the random device.
+ *
+ * @param[out] buf  the output
+ * @param[in]  len  the number of bytes wanted
+ * @returns false if the device cannot be opened or read
+ */
+static bool
+entropy_read_dev(unsigned char * buf, size_t len)
+{
+    int fd = open(NAME_OF_RANDOM_DEVICE, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    while (len > 0) {
+        ssize_t ct = read(fd, buf, len);
+        if (ct <= 0) {
+            if ((ct < 0) && (errno == EINTR))
+                continue;
+            close(fd);
+            return false;
+        }
+        buf += ct;
+        len -= (size_t)ct;
+    }
+
+    close(fd);
+    return true;
+}
+
+/**
+ * Fill a buffer with random bytes.  One getrandom() call nearly always
+ * does it.  If the kernel does not have it, the random device is read.
+ * If neither works, the program exits.
+ *
+ * @param[out] buf  the output
+ * @param[in]  len  the number of bytes wanted
+ */
+static void
+entropy_fill(void * buf, size_t len)
+{
+    unsigned char * scan = buf;
+
+#ifdef HAVE_GETRANDOM
+    while (len > 0) {
+        ssize_t ct = getrandom(scan, len, 0);
+        if (ct < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        scan += ct;
+        len  -= (size_t)ct;
+    }
+
+    if (len == 0)
+        return;
+#endif
+
+    if (! entropy_read_dev(scan, len))
+        die(GNU_PW_MGR_EXIT_NO_ENTROPY, no_entropy);
+}
+
+/**
+ * Fill a buffer with random characters from a set.  Bytes at or above
+ * the largest multiple of the set size a byte can hold are dropped, so
+ * each character is equally likely.  The random bytes for all of them
+ * are drawn at once.  No NUL is added.
+ *
+ * @param[out] buf  the output
+ * @param[in]  len  the number of characters wanted
+ * @param[in]  set  the characters to choose from
+ */
+static void
+entropy_chars(char * buf, size_t len, char const * set)
+{
+    size_t const    set_ct   = strlen(set);
+    unsigned int    limit    = (unsigned int)((256 / set_ct) * set_ct);
+    size_t          pool_len = len + (len / 2) + 16;
+    size_t          used     = pool_len;
+    unsigned char * pool     = malloc(pool_len);
+
+    if (pool == NULL)
+        nomem_err(pool_len, "random bytes");
+
+    while (len > 0) {
+        unsigned char ch;
+
+        if (used >= pool_len) {
+            entropy_fill(pool, pool_len);
+            used = 0;
+        }
+
+        ch = pool[used++];
+        if (ch >= limit)
+            continue;
+
+        *(buf++) = set[ch % set_ct];
+        len--;
+    }
+
+    memset(pool, 0, pool_len);
+    free(pool);
+}
+
+/**
+ * Fill a buffer with random printable ASCII characters, space through
+ * tilde.  No NUL is added.
+ *
+ * @param[out] buf  the output
+ * @param[in]  len  the number of characters wanted
+ */
+static void
+entropy_printable(char * buf, size_t len)
+{
+    entropy_chars(buf, len, entropy_print_chars);
+}
+
+/**
+ * Fill a buffer with random printable ASCII characters that need no
+ * quoting between shell quotes.  No NUL is added.
+ *
+ * @param[out] buf  the output
+ * @param[in]  len  the number of characters wanted
+ */
+static void
+entropy_shell_safe(char * buf, size_t len)
+{
+    entropy_chars(buf, len, entropy_shell_chars);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of entropy.c */
@@ -3,7 +3,7 @@
  * 
  *  This file is part of gnu-pw-mgr.
  *
- *  Copyright (C) 2013-2018 Bruce Korb, all rights reserved.
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
  *  This is free software. It is licensed for use, modification and
  *  redistribution under the terms of the GNU General Public License,
  *  version 3 or later <http://gnu.org/licenses/gpl.html>
@@ -22,24 +22,122 @@
  *  with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-typedef enum { CC_UPPER, CC_LOWER, CC_DIGIT, CC_SPECIAL, CT_CC } ccl_t;
+/*
+ * Character class index.  Anything not alphanumeric is "special",
+ * so that is the zero value.
+ */
+typedef enum { CC_SPECIAL, CC_UPPER, CC_LOWER, CC_DIGIT, CT_CC } ccl_t;
 
-////PULL-HEADERS:
+#define FC_UPPER        0x01U
+#define FC_LOWER        0x02U
+#define FC_DIGIT        0x04U
+#define FC_PUNCT        0x08U
+#define FC_ALPHA        (FC_UPPER | FC_LOWER)
+
+/**
+ * What the fixups need to know about a character, in one lookup.
+ * The classes are those of the "C" locale.
+ */
+typedef struct {
+    unsigned char   fc_ccl;     ///< ccl_t index
+    unsigned char   fc_bits;    ///< FC_* bits
+    unsigned char   fc_next;    ///< next in its class, wrapping:  triplets
+    unsigned char   fc_rot;     ///< rotated in its class:  sequences
+} fix_ctab_t;
+
+#define FC_UC(_c) \
+    [_c] = { CC_UPPER, FC_UPPER, ((_c) == 'Z') ? 'A' : (_c) + 1, \
+             ((_c) + 4 > 'Z') ? (_c) + 4 - 26 : (_c) + 4 }
+#define FC_LC(_c) \
+    [_c] = { CC_LOWER, FC_LOWER, ((_c) == 'z') ? 'a' : (_c) + 1, \
+             ((_c) + 4 > 'z') ? (_c) + 4 - 26 : (_c) + 4 }
+#define FC_DG(_c) \
+    [_c] = { CC_DIGIT, FC_DIGIT, ((_c) == '9') ? '0' : (_c) + 1, \
+             ((_c) < '5') ? (_c) + 5 : (_c) - 5 }
+#define FC_PU(_c) \
+    [_c] = { CC_SPECIAL, FC_PUNCT, 0, 0 }
+
+static fix_ctab_t const fix_ctab[256] = {
+    FC_UC('A'), FC_UC('B'), FC_UC('C'), FC_UC('D'), FC_UC('E'), FC_UC('F'),
+    FC_UC('G'), FC_UC('H'), FC_UC('I'), FC_UC('J'), FC_UC('K'), FC_UC('L'),
+    FC_UC('M'), FC_UC('N'), FC_UC('O'), FC_UC('P'), FC_UC('Q'), FC_UC('R'),
+    FC_UC('S'), FC_UC('T'), FC_UC('U'), FC_UC('V'), FC_UC('W'), FC_UC('X'),
+    FC_UC('Y'), FC_UC('Z'),
+
+    FC_LC('a'), FC_LC('b'), FC_LC('c'), FC_LC('d'), FC_LC('e'), FC_LC('f'),
+    FC_LC('g'), FC_LC('h'), FC_LC('i'), FC_LC('j'), FC_LC('k'), FC_LC('l'),
+    FC_LC('m'), FC_LC('n'), FC_LC('o'), FC_LC('p'), FC_LC('q'), FC_LC('r'),
+    FC_LC('s'), FC_LC('t'), FC_LC('u'), FC_LC('v'), FC_LC('w'), FC_LC('x'),
+    FC_LC('y'), FC_LC('z'),
+
+    FC_DG('0'), FC_DG('1'), FC_DG('2'), FC_DG('3'), FC_DG('4'),
+    FC_DG('5'), FC_DG('6'), FC_DG('7'), FC_DG('8'), FC_DG('9'),
+
+    FC_PU('!'), FC_PU('"'), FC_PU('#'), FC_PU('$'), FC_PU('%'), FC_PU('&'),
+    FC_PU('\''), FC_PU('('), FC_PU(')'), FC_PU('*'), FC_PU('+'), FC_PU(','),
+    FC_PU('-'), FC_PU('.'), FC_PU('/'), FC_PU(':'), FC_PU(';'), FC_PU('<'),
+    FC_PU('='), FC_PU('>'), FC_PU('?'), FC_PU('@'), FC_PU('['), FC_PU('\\'),
+    FC_PU(']'), FC_PU('^'), FC_PU('_'), FC_PU('`'), FC_PU('{'), FC_PU('|'),
+    FC_PU('}'), FC_PU('~')
+};
+
+#undef FC_UC
+#undef FC_LC
+#undef FC_DG
+#undef FC_PU
+
+/*
+ * The class bits for the first, and then the second, character of a class.
+ */
+static uint32_t const ccl_one_bits[CT_CC] = {
+    [CC_SPECIAL] = GPW_CCLASS_SPECIAL,
+    [CC_UPPER]   = GPW_CCLASS_ALPHA | GPW_CCLASS_UPPER,
+    [CC_LOWER]   = GPW_CCLASS_ALPHA | GPW_CCLASS_LOWER,
+    [CC_DIGIT]   = GPW_CCLASS_DIGIT
+};
+
+static uint32_t const ccl_two_bits[CT_CC] = {
+    [CC_SPECIAL] = GPW_CCLASS_TWO_SPECIAL,
+    [CC_UPPER]   = GPW_CCLASS_TWO_UPPER,
+    [CC_LOWER]   = GPW_CCLASS_TWO_LOWER,
+    [CC_DIGIT]   = GPW_CCLASS_TWO_DIGIT
+};
+
+#define FC_BITS(_c)     (fix_ctab[(unsigned char)(_c)].fc_bits)
+
+/*
+ * Each fixup round can undo another's work.  With some "--specials"
+ * settings, they never agree, so the rounds are limited and running out
+ * of them is an error.  No known password needs more than three.
+ */
+#define FIX_PW_MAX_ROUNDS       16
+
+/*
+ * tests/fix-pw-bench.c counts the "count" and "clean" passes over the
+ * password.  Otherwise, this is nothing.
+ */
+#ifndef FIX_PW_PASS
+# define FIX_PW_PASS(_kind)
+#endif
+
+////LIB-HEADERS:
 
 /**
  *  Make sure than any triple characters get fiddled into something with
  *  at most two same characters in a row.
  *
  * @param[in,out] pw  the password string
+ * @param[in]  sequence  true if sequences are disallowed, too
+ * @param[in]  spec      the three special characters
  * @returns true -> all done, false otherwise
  */
 static bool
-clean_triplets(char * pw, bool sequence)
+clean_triplets(char * pw, bool sequence, char const * spec)
 {
     bool res = true;
     unsigned char last = *(pw++);
     if (last == NUL)
-        die(GNU_PW_MGR_EXIT_CODING_ERROR, inv_pwd);
+        return res;
 
     for (;; pw++) {
         if (*pw == NUL)
@@ -60,27 +158,18 @@ clean_triplets(char * pw, bool sequence)
 
         /*
          * Three in a row.  Alter the character under the pointer and
-         * set "last" to that new character.
+         * set "last" to that new character:  the next one in its class.
          */
-        if (isdigit(last)) {
-            if (last++ == '9')
-                last = '0';
-
-        } else if (isupper(last)) {
-            if (last++ == 'Z')
-                last = 'A';
-
-        } else if (islower(last)) {
-            if (last++ == 'z')
-                last = 'a';
+        if (fix_ctab[last].fc_ccl != CC_SPECIAL)
+            last = fix_ctab[last].fc_next;
 
-        } else
+        else
             /*
              * New rule: if sequences are disallowed, then the third
              * repeated special char becomes 'm'. We otherwise could
              * (theoretically) get into an infinite loop.
              */
-            last = sequence ? 'm' : OPT_ARG(SPECIALS)[2];
+            last = sequence ? 'm' : spec[2];
 
         *pw = last;
         res = false;
@@ -91,17 +180,18 @@ clean_triplets(char * pw, bool sequence)
  *  Make sure that no three characters are sequential.
  *
  * @param[in,out] pw  the password string
+ * @param[in]  spec      the three special characters
  * @returns true -> all done, false otherwise
  */
 static bool
-clean_sequence(char * pw)
+clean_sequence(char * pw, char const * spec)
 {
     bool res = true;
     unsigned char last[2];
 
     last[1] = *(pw++);
-    if (last[1] == NUL)
-        die(GNU_PW_MGR_EXIT_CODING_ERROR, inv_pwd);
+    if ((last[1] == NUL) || (*pw == NUL))
+        return res;
 
     /*
      * Until we hit a NUL byte, check current and previous two chars for
@@ -115,31 +205,18 @@ clean_sequence(char * pw)
             continue; // two previous not sequential
 
         /*
-         * We have a triplet sequence. Flip the previous char.
+         * We have a triplet sequence. Flip the previous char:  digits
+         * rotate by 5 and letters shift by 4, within their class.
          */
-        if (isdigit(last[1])) {
-            pw[-1] += (last[1] < '5') ? 5 : -5; // rotate digit 5
-
-        } else if (isupper(last[1])) { // shift upper case by 4
-            char ch = last[1] + 4;
-            if (ch > 'Z')
-                ch = 'A' + (ch - 'Z' - 1);
-            pw[-1] = ch;
-
-        } else if (islower(last[1])) { // shift lower case by 4
-            char ch = last[1] + 4;
-            if (ch > 'z')
-                ch = 'a' + (ch - 'z' - 1);
-            pw[-1] = ch;
+        if (fix_ctab[last[1]].fc_ccl != CC_SPECIAL) {
+            pw[-1] = fix_ctab[last[1]].fc_rot;
 
         } else { // select alternate special char
             /*
              * We have three chars in a row with the middle one a special.
              * Pick another of the three special chars.
              */
-            pw[-1] = (last[1] != OPT_ARG(SPECIALS)[2])
-                ? OPT_ARG(SPECIALS)[2]
-                : OPT_ARG(SPECIALS)[1];
+            pw[-1] = (last[1] != spec[2]) ? spec[2] : spec[1];
         }
         res = false;
     }
@@ -152,29 +229,35 @@ clean_sequence(char * pw)
  *  at most two same characters in a row.
  *
  * @param[in,out] pw  the password string
+ * @param[in]  cclass    the GPW_CCLASS_* requirements
+ * @param[in]  spec      the three special characters
  */
 static bool
-clean_no_three(char * pw)
+clean_no_three(char * pw, uint32_t cclass, char const * spec)
 {
-    bool triplets = (OPT_VALUE_CCLASS & CCLASS_NO_TRIPLETS) ? true : false;
-    bool sequence = (OPT_VALUE_CCLASS & CCLASS_NO_SEQUENCE) ? true : false;
+    bool triplets = (cclass & GPW_CCLASS_NO_TRIPLETS) ? true : false;
+    bool sequence = (cclass & GPW_CCLASS_NO_SEQUENCE) ? true : false;
     bool done     = false;
     bool did_work = false;
 
+    int  rounds   = FIX_PW_MAX_ROUNDS;
+
     assert(triplets || sequence);
 
     /*
      * Loop until both clean_triplets() and clean_sequence() return true.
      */
-    while (! done) {
+    while (! done && (rounds-- > 0)) {
         bool unchanged = false;
+
+        FIX_PW_PASS(clean);
         if (! triplets)
             done = true;
         else
-            done = unchanged = clean_triplets(pw, sequence);
+            done = unchanged = clean_triplets(pw, sequence, spec);
 
         if (sequence) {
-            done = clean_sequence(pw);
+            done = clean_sequence(pw, spec);
             unchanged |= done;
         }
 
@@ -190,11 +273,13 @@ clean_no_three(char * pw)
  * If both alphas and specials are disabled, it is a digits-only password.
  *
  * @param[in,out] pw  the password buffer
+ * @param[in]  cclass    the GPW_CCLASS_* requirements
+ * @param[in]  spec      the three special characters
  */
 static void
-fix_no_alpha_pw(char * pw)
+fix_no_alpha_pw(char * pw, uint32_t cclass, char const * spec)
 {
-    bool force_spec = (OPT_VALUE_CCLASS & CCLASS_SPECIAL) != 0;
+    bool force_spec = (cclass & GPW_CCLASS_SPECIAL) != 0;
     bool no_spec    = true;
 
     for (;;) {
@@ -202,15 +287,15 @@ fix_no_alpha_pw(char * pw)
         if (ch == NUL)
             break;
 
-        if (isalpha(ch))
+        if (FC_BITS(ch) & FC_ALPHA)
             pw[-1] = '0' + (ch % 10);
 
-        else if (! isdigit(ch))
+        else if ((FC_BITS(ch) & FC_DIGIT) == 0)
             no_spec = false;
     }
 
     if (force_spec && no_spec)
-        pw[1] = OPT_ARG(SPECIALS)[2];
+        pw[1] = spec[2];
 }
 
 /**
@@ -226,10 +311,10 @@ fix_lower_only_pw(char * pw)
         if (ch == NUL)
             break;
 
-        if (islower(ch))
+        if (FC_BITS(ch) & FC_LOWER)
             continue;
 
-        if (isupper(ch)) {
+        if (FC_BITS(ch) & FC_UPPER) {
             pw[-1] = 'a' + (ch - 'A');
             continue;
         }
@@ -250,37 +335,37 @@ fix_lower_only_pw(char * pw)
  *
  * @returns the new character class set
  */
-static uintptr_t
-pick_something(uintptr_t ccls, char * pch, int * cta)
+static uint32_t
+pick_something(uint32_t ccls, char * pch, int * cta)
 {
-    if ((ccls & CCLASS_DIGIT) == 0) {
+    if ((ccls & GPW_CCLASS_DIGIT) == 0) {
         *pch = '0' + (*pch & 0x07);
         cta[CC_DIGIT]++;
-        return CCLASS_DIGIT;
+        return GPW_CCLASS_DIGIT;
     }
 
-    if ((ccls & CCLASS_UPPER) == 0) {
+    if ((ccls & GPW_CCLASS_UPPER) == 0) {
         *pch = 'A' + (*pch & 0x0F);
         cta[CC_UPPER]++;
-        return CCLASS_ALPHA | CCLASS_UPPER;
+        return GPW_CCLASS_ALPHA | GPW_CCLASS_UPPER;
     }
 
-    if ((ccls & CCLASS_LOWER) == 0) {
+    if ((ccls & GPW_CCLASS_LOWER) == 0) {
         *pch = 'a' + (*pch & 0x0F);
         cta[CC_LOWER]++;
-        return CCLASS_ALPHA | CCLASS_LOWER;
+        return GPW_CCLASS_ALPHA | GPW_CCLASS_LOWER;
     }
 
-    if ((ccls & CCLASS_TWO_DIGIT) == 0) {
+    if ((ccls & GPW_CCLASS_TWO_DIGIT) == 0) {
         *pch = '0' + (*pch & 0x07);
         cta[CC_DIGIT]++;
-        return CCLASS_TWO_DIGIT;
+        return GPW_CCLASS_TWO_DIGIT;
     }
 
-    if ((ccls & CCLASS_TWO_UPPER) == 0) {
+    if ((ccls & GPW_CCLASS_TWO_UPPER) == 0) {
         *pch = 'A' + (*pch & 0x0F);
         cta[CC_UPPER]++;
-        return CCLASS_ALPHA | CCLASS_TWO_UPPER;
+        return GPW_CCLASS_ALPHA | GPW_CCLASS_TWO_UPPER;
     }
 
     /*
@@ -289,81 +374,85 @@ pick_something(uintptr_t ccls, char * pch, int * cta)
      */
     *pch = 'a' + (*pch & 0x0F);
     cta[CC_LOWER]++;
-    return CCLASS_ALPHA | CCLASS_TWO_LOWER;
+    return GPW_CCLASS_ALPHA | GPW_CCLASS_TWO_LOWER;
 }
 
 /**
- * Count the  character classes in the proposed password.
+ * Count the  character classes in the proposed password.  In the same
+ * pass, look for three of the same character in a row and for three
+ * ascending characters in a row.
  *
  * @param[in] pw            the proposed password
- * @param[in] no_spec       true if special characters are disallowed.
- *                          '+' and '/' are mapped to the (possibly default)
- *                          string argument to the \a --cclass option.
+ * @param[in] cclass        the GPW_CCLASS_* requirements.  If special
+ *                          characters are allowed, '+' and '/' are mapped
+ *                          to the first two of \a spec.
+ * @param[in] spec          the three special characters
  * @param[out] cta          array of character class counts
+ * @param[out] three        GPW_CCLASS_NO_TRIPLETS if a triplet was seen and
+ *                          GPW_CCLASS_NO_SEQUENCE if a sequence was seen
  *
  * @returns the mask of the classes of characters found in \a pw.
  *
  *  The disallowed character classes are always "found",
- * other than the CCLASS_NO_ALPHA class. That implies all digits and
+ * other than the GPW_CCLASS_NO_ALPHA class. That implies all digits and
  * is handled elsewhere.
  */
-static uintptr_t
-count_pw_class(char * pw, bool no_spec, int * cta)
+static uint32_t
+count_pw_class(char * pw, uint32_t cclass, char const * spec, int * cta,
+               uint32_t * three)
 {
-    static uintptr_t const never = CCLASS_NO_SPECIAL | CCLASS_NO_THREE;
+    static uint32_t const never = GPW_CCLASS_NO_SPECIAL | GPW_CCLASS_NO_THREE;
 
-    uintptr_t res = OPT_VALUE_CCLASS & never;
-    char *   scan = pw;
+    bool const no_spec = (cclass & GPW_CCLASS_NO_SPECIAL) != 0;
+    uint32_t   res     = cclass & never;
+    char *     scan    = pw;
+    uint32_t   seen    = 0;
+    int        prev[2] = { -8, -16 }; // cannot match or follow anything
 
     memset(cta, NUL, CT_CC * sizeof(*cta));
 
+    /*
+     * The class count so far says whether this is the first or the
+     * second of its class.  pick_something() keeps the counts, too.
+     */
     for (;;) {
         unsigned char ch = (unsigned char)*(scan++);
-        if (ch == NUL)
+        ccl_t ix;
+
+        if (ch == NUL) {
+            *three = seen;
             return res;
+        }
 
-        if (isdigit(ch)) {
-            cta[CC_DIGIT]++;
-            if ((res & CCLASS_DIGIT) != 0)
-                res |= CCLASS_TWO_DIGIT;
-            else
-                res |= CCLASS_DIGIT;
-
-        } else if (islower(ch)) {
-            cta[CC_LOWER]++;
-
-            if ((res & CCLASS_LOWER) != 0)
-                res |= CCLASS_TWO_LOWER;
-            else
-                res |= CCLASS_ALPHA | CCLASS_LOWER;
-
-        } else if (isupper(ch)) {
-            cta[CC_UPPER]++;
-
-            if ((res & CCLASS_UPPER) != 0)
-                res |= CCLASS_TWO_UPPER;
-            else
-                res |= CCLASS_ALPHA | CCLASS_UPPER;
-
-        } else if (! no_spec) {
-            cta[CC_SPECIAL]++;
-            if ((res & CCLASS_SPECIAL) != 0)
-                res |= CCLASS_TWO_SPECIAL;
-            else
-                res |= CCLASS_SPECIAL;
-
-            if (HAVE_OPT(SPECIALS)) {
+        ix = (ccl_t)fix_ctab[ch].fc_ccl;
+        if (UNLIKELY(ix == CC_SPECIAL)) {
+            /*
+             *  Found a special character, but no specials are allowed.
+             */
+            if (no_spec)
+                res |= pick_something(res, scan-1, cta);
+
+            else {
                 switch (ch) {
-                case '/': scan[-1] = OPT_ARG(SPECIALS)[0]; break;
-                case '+': scan[-1] = OPT_ARG(SPECIALS)[1]; break;
+                case '/': scan[-1] = spec[0]; break;
+                case '+': scan[-1] = spec[1]; break;
                 }
+                res |= (cta[ix]++ == 0) ? ccl_one_bits[ix] : ccl_two_bits[ix];
             }
+            ch = (unsigned char)scan[-1];
 
-        /*
-         *  Found a special character, but no specials are allowed.
-         */
         } else
-            res |= pick_something(res, scan-1, cta);
+            res |= (cta[ix]++ == 0) ? ccl_one_bits[ix] : ccl_two_bits[ix];
+
+        if (ch == prev[0]) {
+            if (ch == prev[1])
+                seen |= GPW_CCLASS_NO_TRIPLETS;
+
+        } else if ((ch == prev[0] + 1) && (prev[0] == prev[1] + 1))
+            seen |= GPW_CCLASS_NO_SEQUENCE;
+
+        prev[1] = prev[0];
+        prev[0] = ch;
     }
 }
 
@@ -372,7 +461,7 @@ find_upper(char * pw)
 {
     pw += strlen(pw);
     for (;;) {
-        if (isupper((unsigned int)*--pw))
+        if (FC_BITS(*--pw) & FC_UPPER)
             return pw;
     }
 }
@@ -382,7 +471,7 @@ find_lower(char * pw)
 {
     pw += strlen(pw);
     for (;;) {
-        if (islower((unsigned int)*--pw))
+        if (FC_BITS(*--pw) & FC_LOWER)
             return pw;
     }
 }
@@ -392,7 +481,7 @@ find_digit(char * pw)
 {
     pw += strlen(pw);
     for (;;) {
-        if (isdigit((unsigned int)*--pw))
+        if (FC_BITS(*--pw) & FC_DIGIT)
             return pw;
     }
 }
@@ -402,7 +491,7 @@ find_special(char * pw)
 {
     pw += strlen(pw);
     for (;;) {
-        if (ispunct((unsigned int)*--pw))
+        if (FC_BITS(*--pw) & FC_PUNCT)
             return pw;
     }
 }
@@ -468,7 +557,7 @@ add_digit(char * pw, int * cta)
 }
 
 static void
-add_special(char * pw, int * cta)
+add_special(char * pw, int * cta, char const * spec)
 {
     if (cta[CC_DIGIT] > 2) {
         pw = find_digit(pw);
@@ -487,7 +576,7 @@ add_special(char * pw, int * cta)
         int ix = cta[CC_SPECIAL]++;
         if (ix > 2)
             ix = 2;
-        *pw = OPT_ARG(SPECIALS)[ix];
+        *pw = spec[ix];
     }
 }
 
@@ -500,22 +589,29 @@ add_special(char * pw, int * cta)
  * a character class get violated.
  *
  * Except for when special characters are required, with reasonable length
- * passwords, it is unusual for this fixup function to do anything.
+ * passwords, it is unusual for this fixup function to do anything.  So the
+ * first counting pass also looks for triplets and sequences.  When nothing
+ * is needed and none are found, that one pass is all there is.  Otherwise,
+ * the rounds of fixing and recounting are limited to FIX_PW_MAX_ROUNDS.
  *
  * @param[in,out] pw  the password buffer
+ * @param[in]  cclass    the GPW_CCLASS_* requirements
+ * @param[in]  spec      the three special characters
+ * @returns false if the rounds ran out, leaving a password that may not
+ * meet the requirements.
  */
-static void
-fix_std_pw(char * pw)
+static bool
+fix_std_pw(char * pw, uint32_t cclass, char const * spec)
 {
-    int cta[4];
-    uintptr_t need;
+    int      cta[4];
+    int      rounds = FIX_PW_MAX_ROUNDS;
+    uint32_t three;
+    uint32_t need;
 
     for (;;) {
-        {
-            bool no_spec = (OPT_VALUE_CCLASS & CCLASS_NO_SPECIAL)  ? true : false;
-            need = count_pw_class(pw, no_spec, cta);
-            need = (need & OPT_VALUE_CCLASS) ^ OPT_VALUE_CCLASS;
-        }
+        FIX_PW_PASS(count);
+        need = count_pw_class(pw, cclass, spec, cta, &three);
+        need = (need & cclass) ^ cclass;
 
         /*
          * IF there are any needs, it is probably because special chars are
@@ -523,47 +619,56 @@ fix_std_pw(char * pw)
          */
         if (UNLIKELY(need != 0)) {
 
-            if (ISLIKELY((need & CCLASS_SPECIAL) != 0))
-                add_special(pw, cta);
+            if (ISLIKELY((need & GPW_CCLASS_SPECIAL) != 0))
+                add_special(pw, cta, spec);
 
-            if (UNLIKELY((need & CCLASS_TWO_SPECIAL) != 0))
-                add_special(pw, cta); // unusual requirement
+            if (UNLIKELY((need & GPW_CCLASS_TWO_SPECIAL) != 0))
+                add_special(pw, cta, spec); // unusual requirement
 
             /*
-             * "need" are the bits in OPT_VALUE_CLASS not found by count_pw_class
+             * "need" are the bits in cclass not found by count_pw_class
              *
              * requiring "alpha" is always one-only and can never be in
              * conjunction with upper or lower.
              */
-            if ((need & CCLASS_ALPHA) != 0)
+            if ((need & GPW_CCLASS_ALPHA) != 0)
                 add_upper(pw, cta);
 
             else {
-                if ((need & CCLASS_UPPER) != 0)
+                if ((need & GPW_CCLASS_UPPER) != 0)
                     add_upper(pw, cta);
 
-                if (UNLIKELY((need & CCLASS_TWO_UPPER) != 0))
+                if (UNLIKELY((need & GPW_CCLASS_TWO_UPPER) != 0))
                     add_upper(pw, cta);
 
-                if ((need & CCLASS_LOWER) != 0)
+                if ((need & GPW_CCLASS_LOWER) != 0)
                     add_lower(pw, cta);
 
-                if (UNLIKELY((need & CCLASS_TWO_LOWER) != 0))
+                if (UNLIKELY((need & GPW_CCLASS_TWO_LOWER) != 0))
                     add_lower(pw, cta);
             }
 
-            if ((need & CCLASS_DIGIT) != 0)
+            if ((need & GPW_CCLASS_DIGIT) != 0)
                 add_digit(pw, cta);
 
-            if (UNLIKELY((need & CCLASS_TWO_DIGIT) != 0))
+            if (UNLIKELY((need & GPW_CCLASS_TWO_DIGIT) != 0))
                 add_digit(pw, cta);
         }
 
-        if (ISLIKELY((OPT_VALUE_CCLASS & CCLASS_NO_THREE) == 0))
-            return;
+        if (ISLIKELY((cclass & GPW_CCLASS_NO_THREE) == 0))
+            return true;
 
-        if (ISLIKELY(! clean_no_three(pw)))
-            return;
+        /*
+         * Nothing was added and the count found nothing to clean.
+         */
+        if (ISLIKELY((need == 0) && ((three & cclass) == 0)))
+            return true;
+
+        if (ISLIKELY(! clean_no_three(pw, cclass, spec)))
+            return true;
+
+        if (UNLIKELY(--rounds <= 0))
+            return false;
         /*
          * "clean_no_three()" did some cleaning, so recompute
          * the satisfied classes and try again.
@@ -580,9 +685,10 @@ fix_std_pw(char * pw)
  *
  * @param[out] pw    the password buffer
  * @param[in]  sums  the sha256 sums as seen as pointer sized integers
+ * @param[in]  len   the PIN length
  */
 static void
-fix_digit_pw(char * pw, uintptr_t * sums)
+fix_digit_pw(char * pw, uintptr_t const * sums, size_t len)
 {
     /*
      * log10((2 ^^ 64) - 1) is 20, plus a NUL and round up to multiple of
@@ -593,7 +699,7 @@ fix_digit_pw(char * pw, uintptr_t * sums)
     size_t str_ln;
     int    lp_lim = 256 / (NBBY * sizeof(*sums));
 
-    for (need_ln = OPT_VALUE_LENGTH; (lp_lim-- > 0) && (need_ln > 0); ) {
+    for (need_ln = len; (lp_lim-- > 0) && (need_ln > 0); ) {
         sprintf(bf, "%lu", *(sums++));
         str_ln = strlen(bf);
         if (str_ln < 5)
@@ -611,8 +717,16 @@ fix_digit_pw(char * pw, uintptr_t * sums)
     while (need_ln > 0) {
         size_t cln = (need_ln > 10) ? 10 : need_ln;
         need_ln -= cln;
-        memcpy(pw, digits_z, cln);
+        memcpy(pw, gpw_digits, cln);
         pw += cln;
     }
     *pw = NUL;
 }
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of fix-pw.c */
@@ -26,176 +26,34 @@
 ////PULL-HEADERS:
 
 /**
- * Compute a confirmation answer from the password id and question
- *
- * @param buf        confirmation string output
- * @param bsz        output buffer length
- * @param data       hash data
- * @param d_len      size of hash data
- * @param pwd_id_str password id string
- */
-static void
-set_confirm_value(char * buf, size_t bsz, unsigned char * data, size_t d_len,
-                  char const * pwd_id_str)
-{
-    const int buf_off = CONFIRM_LEN + 1;
-    assert(bsz > (buf_off * 2));
-
-    /*
-     * The user wants the old style, changeable confirmation answer.
-     * It has already been computed in "data".
-     */
-    if (! HAVE_OPT(OLD_CONFIRM)) {
-        union {
-            uintptr_t       data[256 / (NBBY * sizeof(uintptr_t))];
-            unsigned char   sha_buf[256 / NBBY];
-        } sum;
-
-        struct sha256_ctx ctx;
-
-	/*
-	 * compute a new hash based only on the password id string and
-	 * the confirmation text
-	 */
-        sha256_init_ctx(&ctx);
-        sha256_process_bytes(pwd_id_str, strlen(pwd_id_str)+1, &ctx);
-        sha256_process_bytes(OPT_ARG(CONFIRM), strlen(OPT_ARG(CONFIRM))+1, &ctx);
-        sha256_finish_ctx(&ctx, sum.sha_buf);
-
-	data   = (unsigned char *)sum.sha_buf;
-	d_len  = sizeof(sum.sha_buf);
-    }
-
-    base64_encode((char *)data, d_len, buf, buf_off);
-    buf[CONFIRM_LEN] = NUL;
-    fix_lower_only_pw(buf);
-}
-
-/**
- * Convert the hash data to a password.  Uses base64 encoding, mostly,
- * but atoi for PIN numbers (decimal digits only passwords).
+ * derive and encode the password for a seed.  If there is a confirmation
+ * question, the answer is made instead.  Normally, the answer depends
+ * only on the password id and the question.  The user may want the old
+ * style, changeable answer that is made from the derived hash.
  *
  * @param buf   result buffer
  * @param bsz   buffer size
- * @param data  the raw hash code
- * @param d_len the length of the raw hash
+ * @param prm   the derivation parameters
  */
 static void
-adjust_pw(char * buf, size_t bsz, unsigned char * data, size_t d_len,
-          char const * pwd_id_str)
+derive_pw(char * buf, size_t bsz, gpw_params_t const * prm)
 {
-    char * dta = (char *)data;
-    unsigned int cclass = OPT_VALUE_CCLASS
-        & (CCLASS_NO_ALPHA | CCLASS_NO_SPECIAL);
-
-    // Check for PIN number password:
-    //
-    if (cclass == (CCLASS_NO_ALPHA | CCLASS_NO_SPECIAL)) {
-        static uint32_t const bytes_per_val = 7
-#if SIZEOF_CHARP > 4
-            + 10
-#endif
-            ;
-        uint32_t mx = (d_len / sizeof(uintptr_t)) * bytes_per_val;
-        if (OPT_VALUE_LENGTH > mx)
-            die(GNU_PW_MGR_EXIT_INVALID, pin_too_big,
-                (uint32_t)OPT_VALUE_LENGTH, mx);
-
-        fix_digit_pw(buf, (uintptr_t *)(uintptr_t)data);
-
-    } else {
-        base64_encode(dta, d_len, buf, bsz);
-        buf[OPT_VALUE_LENGTH] = NUL;
-
-        if (cclass == CCLASS_NO_ALPHA)
-            fix_no_alpha_pw(buf);
-        else
-            fix_std_pw(buf);
+    unsigned char hash[GPW_HASH_MAX];
+
+    if (prm->gp_confirm == NULL) {
+        check_gpw_rc(gpw_derive(prm, buf, bsz), prm);
+        return;
     }
-}
 
-/**
- * hash and encode the seed tag, the seed and the password id.
- * Use the original glue-the-text-together-and-hash method.
- *
- * @param buf          result buffer
- * @param bsz          buffer size
- * @param tag          the seed tag
- * @param txt          the password seed
- * @param pwd_id_str   the password id
- */
-static void
-get_dft_pw(char * buf, size_t bsz,
-           char const * tag, char const * txt, char const * pwd_id_str)
-{
-    union {
-        uintptr_t       data[256 / (NBBY * sizeof(uintptr_t))];
-        unsigned char   sha_buf[256 / NBBY];
-    } sum;
-
-    struct sha256_ctx ctx;
-    sha256_init_ctx(&ctx);
-
-    sha256_process_bytes(tag, strlen(tag)+1, &ctx);
-    sha256_process_bytes(txt, strlen(txt)+1, &ctx);
-    sha256_process_bytes(pwd_id_str, strlen(pwd_id_str)+1, &ctx);
-    if (HAVE_OPT(CONFIRM))
-        sha256_process_bytes(OPT_ARG(CONFIRM), strlen(OPT_ARG(CONFIRM))+1, &ctx);
-    sha256_finish_ctx(&ctx, sum.sha_buf);
-
-    if (HAVE_OPT(CONFIRM))
-        set_confirm_value(buf, bsz, sum.sha_buf, sizeof(sum.sha_buf), pwd_id_str);
-    else
-        adjust_pw(buf, bsz, sum.sha_buf, sizeof(sum.sha_buf), pwd_id_str);
-}
+    if (! HAVE_OPT(OLD_CONFIRM)) {
+        check_gpw_rc(gpw_confirm_answer(prm, NULL, 0, buf, bsz), prm);
+        return;
+    }
 
-/**
- * hash and encode the seed tag, the seed and the password id.
- * Use the pbkdf2 method. (Password Based Key Derivation Function, version 2)
- *
- * @param buf   result buffer
- * @param bsz   buffer size
- * @param tag   the seed tag
- * @param salt  the password seed/salt
- * @param nam   the password id
- */
-static void
-get_rehashed_pw(char * buf, size_t bsz,
-                char const * tag, char const * salt, char const * pwd_id_str)
-{
-    size_t const stag_len = strlen(tag) + 1;  // seed tag len
-    size_t const salt_len = strlen(salt) + 1; // salt length
-    size_t const pwid_len = strlen(pwd_id_str) + 1;
-    size_t const conf_len =
-	HAVE_OPT(CONFIRM) ? (strlen(OPT_ARG(CONFIRM)) + 1) : 0;
-    
-    size_t const hash_src_len = stag_len + pwid_len + conf_len;
-    size_t const hash_out_len = 4 + ((bsz * 6) >> 3);
-
-    char * hash_source = scribble_get(hash_src_len);
-    char * hash_output = scribble_get(hash_out_len);
-    Gc_rc rc;
-
-    memcpy(hash_source, tag, stag_len);
-    memcpy(hash_source + stag_len, pwd_id_str, pwid_len);
-
-    if (conf_len > 0)
-        memcpy(hash_source + stag_len + pwid_len, OPT_ARG(CONFIRM), conf_len);
-
-    rc = gc_pbkdf2_hmac(GC_SHA1,
-                        hash_source, hash_src_len,
-                        salt,        salt_len,
-                        OPT_VALUE_PBKDF2,
-                        hash_output, hash_out_len);
-    if (rc != GC_OK)
-        die(GNU_PW_MGR_EXIT_INVALID, pbkdf2_err_fmt, rc);
-
-    if (HAVE_OPT(CONFIRM))
-        set_confirm_value(buf, bsz, (unsigned char *)hash_output,
-			  hash_out_len, pwd_id_str);
-    else
-        adjust_pw(buf, bsz, (unsigned char *)hash_output,
-		  hash_out_len, pwd_id_str);
+    check_gpw_rc(gpw_derive_hash(prm, hash, sizeof(hash)), prm);
+    check_gpw_rc(gpw_confirm_answer(prm, hash, gpw_hash_len(prm), buf, bsz),
+                 prm);
+    memset(hash, 0, sizeof(hash));
 }
 
 /**
@@ -210,13 +68,14 @@ print_pwid_header(char const * pwd_id_str)
 }
 
 /**
- * Print the passwords for \a pwd_id_str.
- * @param pwd_id_str  the pwd_id_str/id for which a password is needed
+ * Print the stored settings for a password id.
+ * @param prm  the derivation context of the password id
  */
 static void
-print_pwid_status(char const * pwd_id_str)
+print_pwid_status(gpw_params_t const * prm)
 {
-    bool have_data = false;
+    char const * pwd_id_str = prm->gp_pwid;
+    bool         have_data  = false;
 
     if (HAVE_OPT(LOGIN_ID)) {
         have_data = true;
@@ -229,18 +88,36 @@ print_pwid_status(char const * pwd_id_str)
             print_pwid_header(pwd_id_str);
             have_data = true;
         }
-        printf(pwst_dig_fmt, DESC(LENGTH).pz_Name, (unsigned int)OPT_VALUE_LENGTH);
+        printf(pwst_dig_fmt, DESC(LENGTH).pz_Name, prm->gp_length);
     }
 
-    if (HAVE_OPT(PBKDF2) || (OPT_VALUE_LENGTH > (MIN_BUF_LEN - 8))) {
+    if (HAVE_OPT(PBKDF2) || (prm->gp_length > GPW_KDF_MAX_LENGTH)) {
         if (! have_data) {
             print_pwid_header(pwd_id_str);
             have_data = true;
         }
-        if (ENABLED_OPT(PBKDF2) || (OPT_VALUE_LENGTH > (MIN_BUF_LEN - 8)))
-            printf(pwst_dig_fmt, "rehash ct", (unsigned int)OPT_VALUE_PBKDF2);
+        if (ENABLED_OPT(PBKDF2) || (prm->gp_length > GPW_KDF_MAX_LENGTH))
+            printf(pwst_dig_fmt, rehash_ct_z, (unsigned int)OPT_VALUE_PBKDF2);
         else
-            printf(pwst_str_fmt, DESC(REHASH).pz_Name, "not used");
+            printf(pwst_str_fmt, DESC(REHASH).pz_Name, not_used_z);
+    }
+
+    if (HAVE_OPT(KDF)) {
+        if (! have_data) {
+            print_pwid_header(pwd_id_str);
+            have_data = true;
+        }
+        printf(pwst_str_fmt, DESC(KDF).pz_Name,
+               gpw_kdf_name(prm->gp_kdf));
+    }
+
+    if (HAVE_OPT(ARGON2_COST) || (prm->gp_kdf == GPW_KDF_ARGON2ID)) {
+        if (! have_data) {
+            print_pwid_header(pwd_id_str);
+            have_data = true;
+        }
+        printf(pwst_argon2_fmt, DESC(ARGON2_COST).pz_Name,
+               prm->gp_passes, prm->gp_mem_kib, prm->gp_lanes);
     }
 
     if (HAVE_OPT(SPECIALS)) {
@@ -248,7 +125,7 @@ print_pwid_status(char const * pwd_id_str)
             print_pwid_header(pwd_id_str);
             have_data = true;
         }
-        printf(pwst_str_fmt, DESC(SPECIALS).pz_Name, OPT_ARG(SPECIALS));
+        printf(pwst_str_fmt, DESC(SPECIALS).pz_Name, prm->gp_specials);
     }
 
     if (HAVE_OPT(CCLASS)) {
@@ -306,8 +183,19 @@ select_chars(unsigned char * txtbuf)
     strcpy((char *)txtbuf, buf);
 }
 
+/**
+ * Check that a seed may be used for the current password id.
+ * Seeds without a version are too old and are ignored with a warning.
+ * The seed's "shared" marking must match that of the password id.
+ *
+ * @param[in]  seed_opt  the seed option value
+ * @param[out] tag       the seed's tag
+ * @param[out] txt       the seed's text
+ * @returns true if the seed is usable
+ */
 static bool
-print_one_pwid(tOptionValue const * seed_opt, char const * pwd_id_str)
+usable_seed(tOptionValue const * seed_opt,
+            char const ** tag, char const ** txt)
 {
     if (seed_opt->valType != OPARG_TYPE_HIERARCHY)
         die(GNU_PW_MGR_EXIT_BAD_SEED, bad_seed);
@@ -320,8 +208,8 @@ print_one_pwid(tOptionValue const * seed_opt, char const * pwd_id_str)
         tOptionValue const * ver = optionGetValue(seed_opt, s_ver_z);
 
         if ((ver == NULL) || (ver->valType != OPARG_TYPE_NUMERIC)) {
-            tOptionValue const * tag = optionGetValue(seed_opt, tag_z);
-            warning_msg(too_old_fmt, tag->v.strVal);
+            tOptionValue const * tg = optionGetValue(seed_opt, tag_z);
+            warning_msg(too_old_fmt, tg->v.strVal);
             return false;
         }
     }
@@ -337,43 +225,75 @@ print_one_pwid(tOptionValue const * seed_opt, char const * pwd_id_str)
             return false;
     }
 
-    /*
-     * The gauntlett has been run.  Now print the password.
-     */
-    tOptionValue const * tag = optionGetValue(seed_opt, tag_z);
-    tOptionValue const * txt = optionGetValue(seed_opt, text_z);
+    {
+        tOptionValue const * tg = optionGetValue(seed_opt, tag_z);
+        tOptionValue const * tx = optionGetValue(seed_opt, text_z);
 
-    if (  (tag->valType != OPARG_TYPE_STRING)
-       || (tag->valType != OPARG_TYPE_STRING))
-        die(GNU_PW_MGR_EXIT_BAD_SEED, bad_seed);
+        if (  (tg->valType != OPARG_TYPE_STRING)
+           || (tx->valType != OPARG_TYPE_STRING))
+            die(GNU_PW_MGR_EXIT_BAD_SEED, bad_seed);
+
+        *tag = tg->v.strVal;
+        *txt = tx->v.strVal;
+    }
+
+    return true;
+}
+
+/**
+ * Print the password for one seed.
+ *
+ * @param seed_opt  the seed option value
+ * @param pwid_prm  the derivation context of the password id
+ * @returns true if the seed was usable
+ */
+static bool
+print_one_pwid(tOptionValue const * seed_opt, gpw_params_t const * pwid_prm)
+{
+    gpw_params_t    prm    = *pwid_prm;
+    char const *    no_q   = NULL;
+    char const **   q_list = &no_q;
+    int             q_ct   = 1;
+    int             ix;
+    scribble_mark_t mk;
 
     /*
-     * Use the PBKDF function if it is requested or if the result
-     * length exceeds what we can provide with 256 bits of hash
-     * (40 bytes).
+     * Run the gauntlett.  If the seed passes, print the password.
      */
+    if (! usable_seed(seed_opt, &prm.gp_tag, &prm.gp_text))
+        return false;
+
     /*
      * The "txtbuf" is much larger than needed.  It gets trimmed.
      * This way, base64encode can encode all the data,
+     * It is released again once printed.
      */
-    size_t buf_len = (OPT_VALUE_LENGTH > (MIN_BUF_LEN - 8))
-        ? OPT_VALUE_LENGTH + 16 : MIN_BUF_LEN;
-    unsigned char * txtbuf = scribble_get(buf_len);
-
-    if (  (OPT_VALUE_PBKDF2 == 0)
-       || ! ENABLED_OPT(PBKDF2)
-       || (OPT_VALUE_LENGTH > (MIN_BUF_LEN - 8)) )
+    mk = scribble_mark();
+    unsigned char * txtbuf = scribble_get(GPW_PW_BUF_SIZE);
 
-        get_dft_pw((char *)txtbuf, buf_len,
-                   tag->v.strVal, txt->v.strVal, pwd_id_str);
+    /*
+     * Answer every confirmation question.  Unless old style answers are
+     * wanted, each one is a single SHA-256 and the seed is never hashed.
+     * With more than one question, the question follows its answer.
+     */
+    if (HAVE_OPT(CONFIRM)) {
+        q_ct   = STACKCT_OPT(CONFIRM);
+        q_list = STACKLST_OPT(CONFIRM);
+    }
 
-    else
-        get_rehashed_pw((char *)txtbuf, buf_len,
-			tag->v.strVal, txt->v.strVal, pwd_id_str);
+    for (ix = 0; ix < q_ct; ix++) {
+        prm.gp_confirm = q_list[ix];
+        derive_pw((char *)txtbuf, GPW_PW_BUF_SIZE, &prm);
 
-    if (HAVE_OPT(SELECT_CHARS))
-        select_chars(txtbuf);
-    printf(pw_fmt, tag->v.strVal, txtbuf);
+        if (HAVE_OPT(SELECT_CHARS))
+            select_chars(txtbuf);
+        if (q_ct > 1)
+            printf(confirm_fmt, prm.gp_tag, txtbuf, q_list[ix]);
+        else
+            printf(pw_fmt, prm.gp_tag, txtbuf);
+    }
+    memset(txtbuf, 0, GPW_PW_BUF_SIZE);
+    scribble_release(mk);
     return true;
 }
 
@@ -386,23 +306,39 @@ print_pwid(char const * pwd_id_str)
 {
     tOptionValue const * ov = optionFindValue(&DESC(SEED), NULL, NULL);
     bool printed_pw = false;
+    gpw_params_t prm;
 
     if (*pwd_id_str == NUL)
         die(GNU_PW_MGR_EXIT_NO_PWID, no_pwid);
 
     load_config_file();
-    set_pwid_opts(pwd_id_str);
+    set_pwid_opts(pwd_id_str, &prm);
     if (HAVE_OPT(STATUS)) {
-        print_pwid_status(pwd_id_str);
+        print_pwid_status(&prm);
         return;
     }
 
     if (HAVE_OPT(DELETE)) {
-        remove_pwid(pwd_id_str);
+        remove_pwid(&prm);
         return;
     }
 
     scribble_free();
+    if (HAVE_OPT(VARIANTS)) {
+        print_variants(&prm);
+        return;
+    }
+
+    if (HAVE_OPT(WHICH)) {
+        which_pw(&prm);
+        return;
+    }
+
+    if (HAVE_OPT(KEYFILE)) {
+        print_keyfile(&prm);
+        return;
+    }
+
     if (! HAVE_OPT(NO_HEADER)) {
         char const * hdr_type = hdr_normal;
         if (HAVE_OPT(CONFIRM)) {
@@ -418,7 +354,7 @@ print_pwid(char const * pwd_id_str)
      * For each <seed> value in the config file, print a password.
      */
     do  {
-        printed_pw |= print_one_pwid(ov, pwd_id_str);
+        printed_pw |= print_one_pwid(ov, &prm);
         ov = optionFindNextValue(&DESC(SEED), ov, NULL, NULL);
     } while (ov != NULL);
 
@@ -427,7 +363,7 @@ print_pwid(char const * pwd_id_str)
             ENABLED_OPT(SHARED) ? sec_pw_type : "");
 
     if (update_stored_opts)
-        update_pwid_opts(pwd_id_str);
+        update_pwid_opts(&prm);
 }
 
 /**
@@ -558,17 +494,20 @@ main(int argc, char ** argv)
     if (gnu_pw_mgrOptions.pOptDesc[INDEX_OPT_LOAD_OPTS].optOccCt != 1)
         die(GNU_PW_MGR_EXIT_INVALID, had_load_opts);
 
-    if (HAVE_OPT(DOMAIN))
+    if (have_dom_opts())
         proc_dom_opts(argc);
 
     /*
-     * There are five operational modes:
+     * There are eight operational modes:
      *
      * 1) command line operands signify printing a password, otherwise
      * 2) not having a --tag option says to read a password id from stdin, else
      * 3) not having --text option says to remove a seed, else
      * 4) add a new password seed using --tag and --text
      * 5) change the character class defaults.
+     * 6) self test and time the key derivation functions.
+     * 7) report old and new passwords for every domain.
+     * 8) print random seed texts.
      */
     if (argc > 0) {
         char const * arg;
@@ -589,13 +528,24 @@ main(int argc, char ** argv)
     } else if (HAVE_OPT(DEFAULT_CCLASS)) {
 	set_default_cclass();
 
+    } else if (HAVE_OPT(KDF_BENCH)) {
+        kdf_bench();
+
+    } else if (HAVE_OPT(GENERATE_SEEDS)) {
+        generate_seeds();
+
+    } else if (HAVE_OPT(ROTATION_REPORT)) {
+        if (! HAVE_OPT(SEED))
+            die(GNU_PW_MGR_EXIT_NO_SEED, no_seeds);
+        rotation_report();
+
     } else if (! HAVE_OPT(TAG)) {
 
         /*
          * If the domain option was provided and we don't have a tag opt,
          * then presume someone just wanted to fiddle domain info.
          */
-        if (! HAVE_OPT(DOMAIN))
+        if (! have_dom_opts())
             stdin_pwid();
 
     } else if (HAVE_OPT(TEXT)) {
@@ -0,0 +1,243 @@
+/**
+ * @file gnupwmgr.h
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The gnu-pw-mgr password derivation library.  A password is derived
+ * from a seed (a tag and a secret text), a password id and the settings
+ * for that password id.  Everything needed is passed in a gpw_params_t,
+ * so any number of threads may derive passwords at the same time.
+ * Reading the configuration file is left to the caller.
+ */
+
+#ifndef GNUPWMGR_H_GUARD
+#define GNUPWMGR_H_GUARD 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Character class requirements.  These are the values of the keywords
+ * of the gnu-pw-mgr "--cclass" option.
+ */
+#define GPW_CCLASS_ALPHA        0x0001U
+#define GPW_CCLASS_UPPER        0x0002U
+#define GPW_CCLASS_LOWER        0x0004U
+#define GPW_CCLASS_DIGIT        0x0008U
+#define GPW_CCLASS_SPECIAL      0x0010U
+#define GPW_CCLASS_NO_SPECIAL   0x0020U
+#define GPW_CCLASS_NO_ALPHA     0x0040U
+#define GPW_CCLASS_NO_TRIPLETS  0x0080U
+#define GPW_CCLASS_NO_SEQUENCE  0x0100U
+#define GPW_CCLASS_PIN          0x0200U
+#define GPW_CCLASS_ALNUM        0x0400U
+#define GPW_CCLASS_TWO_UPPER    0x0800U
+#define GPW_CCLASS_TWO_LOWER    0x1000U
+#define GPW_CCLASS_TWO_DIGIT    0x2000U
+#define GPW_CCLASS_TWO_SPECIAL  0x4000U
+#define GPW_CCLASS_NO_THREE     (GPW_CCLASS_NO_TRIPLETS | GPW_CCLASS_NO_SEQUENCE)
+#define GPW_CCLASS_DEFAULT      (GPW_CCLASS_ALPHA | GPW_CCLASS_DIGIT)
+
+#define GPW_MIN_LENGTH          4    ///< shortest PIN number
+#define GPW_MIN_PW_LENGTH       8    ///< shortest non-PIN password
+#define GPW_MAX_LENGTH          128
+#define GPW_DFT_LENGTH          16
+#define GPW_CONFIRM_LEN         12   ///< confirmation answer length
+#define GPW_PW_BUF_SIZE         (GPW_MAX_LENGTH + 16) ///< fits any password
+#define GPW_HASH_MAX            64   ///< longest derived hash
+#define GPW_KDF_MAX_LENGTH      40   ///< longer passwords use the sha256 sum
+
+#define GPW_DFT_REHASH          10007
+#define GPW_MAX_REHASH          100000
+#define GPW_DFT_SPECIALS        "/+-"
+
+#define GPW_ARGON2_DFT_PASSES   3
+#define GPW_ARGON2_DFT_MEM_KIB  65536
+#define GPW_ARGON2_DFT_LANES    4
+#define GPW_ARGON2_MAX_PASSES   1000
+#define GPW_ARGON2_MAX_MEM_KIB  (4UL * 1024 * 1024)
+#define GPW_ARGON2_MAX_LANES    64
+
+/**
+ * Key derivation functions.  Apart from the plain sha256 sum, these are
+ * in the order of the keywords of the gnu-pw-mgr "--kdf" option.  The sum
+ * is used when rehashing is disabled, or the password is longer than
+ * GPW_KDF_MAX_LENGTH characters.
+ */
+typedef enum {
+    GPW_KDF_SHA256 = -1,        ///< plain sha256 sum, no rehashing
+    GPW_KDF_PBKDF2_SHA1,
+    GPW_KDF_PBKDF2_SHA256,
+    GPW_KDF_PBKDF2_SHA512,
+    GPW_KDF_ARGON2ID,
+    GPW_KDF_CT
+} gpw_kdf_t;
+
+typedef enum {
+    GPW_OK = 0,
+    GPW_ERR_INVALID,            ///< a parameter is missing or out of range
+    GPW_ERR_LENGTH,             ///< the length is invalid for the classes
+    GPW_ERR_PIN_LENGTH,         ///< the PIN is longer than the hash allows
+    GPW_ERR_BUF_SIZE,           ///< the output buffer is too small
+    GPW_ERR_NO_MEM,             ///< memory allocation failed
+    GPW_ERR_KDF,                ///< the key derivation function failed
+    GPW_ERR_SPECIALS,           ///< the specials cannot meet the classes
+    GPW_ERR_CT
+} gpw_err_t;
+
+/**
+ * Everything a password depends upon.  Initialize with gpw_params_init()
+ * and then fill in the seed and password id.  The strings are not copied.
+ * The Argon2 lanes are filled with up to one thread per processor.  A
+ * caller that is already deriving several hashes in parallel should set
+ * \a gp_threads to one.  It does not change the result.
+ */
+typedef struct {
+    char const *    gp_tag;        ///< seed tag
+    char const *    gp_text;       ///< seed text
+    char const *    gp_pwid;       ///< password id
+    char const *    gp_confirm;    ///< confirmation question, or NULL
+    char const *    gp_specials;   ///< three special characters, or NULL
+    unsigned int    gp_length;     ///< password length
+    uint32_t        gp_cclass;     ///< GPW_CCLASS_* bits
+    gpw_kdf_t       gp_kdf;        ///< key derivation function
+    unsigned long   gp_rehash;     ///< iteration count, zero to disable
+    unsigned int    gp_passes;     ///< Argon2 passes over memory
+    unsigned int    gp_mem_kib;    ///< Argon2 memory size, in KiB
+    unsigned int    gp_lanes;      ///< Argon2 lanes
+    unsigned int    gp_threads;    ///< Argon2 lane threads, zero for auto
+} gpw_params_t;
+
+/**
+ * Set the defaults:  16 characters, letters and digits, PBKDF2 with SHA-1
+ * and 10007 iterations.  The seed and password id are set to NULL.
+ */
+extern void
+gpw_params_init(gpw_params_t * prm);
+
+/**
+ * @returns the length of the hash derived for \a prm.
+ */
+extern size_t
+gpw_hash_len(gpw_params_t const * prm);
+
+/**
+ * Derive the hash for \a prm.  This is the expensive part.
+ * The confirmation question, if any, is part of the hash source.
+ *
+ * @param prm       the derivation parameters
+ * @param hash      the output, at least gpw_hash_len(prm) bytes
+ * @param hash_len  the size of \a hash
+ */
+extern gpw_err_t
+gpw_derive_hash(gpw_params_t const * prm, unsigned char * hash,
+                size_t hash_len);
+
+/**
+ * Encode a derived hash as a password with the length, character
+ * classes and special characters in \a prm.  This is cheap, so one
+ * hash can be tried with many settings.
+ *
+ * @param prm       the encoding parameters
+ * @param hash      the derived hash
+ * @param hash_len  its length
+ * @param pw        the password output
+ * @param pw_size   the size of \a pw, more than the password length
+ */
+extern gpw_err_t
+gpw_encode(gpw_params_t const * prm, unsigned char const * hash,
+           size_t hash_len, char * pw, size_t pw_size);
+
+/**
+ * Derive and encode a password.
+ */
+extern gpw_err_t
+gpw_derive(gpw_params_t const * prm, char * pw, size_t pw_size);
+
+/**
+ * Make a confirmation question answer of GPW_CONFIRM_LEN lower case
+ * letters.  With a NULL \a hash, the answer depends only on the password
+ * id and the question, so it survives seed changes.  Otherwise, it is
+ * made from a hash derived with the question.
+ */
+extern gpw_err_t
+gpw_confirm_answer(gpw_params_t const * prm, unsigned char const * hash,
+                   size_t hash_len, char * answer, size_t answer_size);
+
+/**
+ * @returns the longest password that can be made with \a prm.  PIN
+ * numbers are limited by the size of the derived hash.
+ */
+extern unsigned int
+gpw_max_length(gpw_params_t const * prm);
+
+/**
+ * @returns the key derivation function that \a prm selects,
+ * or GPW_KDF_CT if \a gp_kdf is not valid.
+ */
+extern gpw_kdf_t
+gpw_kdf_used(gpw_params_t const * prm);
+
+/**
+ * @returns the name of a key derivation function, or NULL.
+ */
+extern char const *
+gpw_kdf_name(gpw_kdf_t kdf);
+
+/**
+ * Run the known answer tests for a key derivation function.
+ *
+ * @returns true if all passed
+ */
+extern bool
+gpw_kdf_self_test(gpw_kdf_t kdf);
+
+/**
+ * Base64 encode \a in, as gnulib's base64_encode() does:  as much as
+ * fits in \a outlen bytes, with a NUL terminator if there is room.
+ * SSSE3 or AVX2 is used when the CPU has it.
+ */
+extern void
+gpw_base64_encode(void const * in, size_t inlen, char * out, size_t outlen);
+
+/**
+ * @returns a description of \a err.
+ */
+extern char const *
+gpw_strerror(gpw_err_t err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GNUPWMGR_H_GUARD */
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of gnupwmgr.h */
@@ -0,0 +1,211 @@
+/**
+ * @file kdf-opts.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The password derivation itself is in libgnupwmgr.  This file turns
+ * the option settings for a password id into library parameters.
+ */
+
+/*
+ * The library has its own names for the "--cclass" bits and the "--kdf"
+ * keywords.  They must have the values that the options have.
+ */
+typedef char gpw_cclass_check_t[
+    (  (CCLASS_ALPHA       == GPW_CCLASS_ALPHA)
+    && (CCLASS_UPPER       == GPW_CCLASS_UPPER)
+    && (CCLASS_LOWER       == GPW_CCLASS_LOWER)
+    && (CCLASS_DIGIT       == GPW_CCLASS_DIGIT)
+    && (CCLASS_SPECIAL     == GPW_CCLASS_SPECIAL)
+    && (CCLASS_NO_SPECIAL  == GPW_CCLASS_NO_SPECIAL)
+    && (CCLASS_NO_ALPHA    == GPW_CCLASS_NO_ALPHA)
+    && (CCLASS_NO_TRIPLETS == GPW_CCLASS_NO_TRIPLETS)
+    && (CCLASS_NO_SEQUENCE == GPW_CCLASS_NO_SEQUENCE)
+    && (CCLASS_PIN         == GPW_CCLASS_PIN)
+    && (CCLASS_ALNUM       == GPW_CCLASS_ALNUM)
+    && (CCLASS_TWO_UPPER   == GPW_CCLASS_TWO_UPPER)
+    && (CCLASS_TWO_LOWER   == GPW_CCLASS_TWO_LOWER)
+    && (CCLASS_TWO_DIGIT   == GPW_CCLASS_TWO_DIGIT)
+    && (CCLASS_TWO_SPECIAL == GPW_CCLASS_TWO_SPECIAL)) ? 1 : -1];
+
+typedef char gpw_kdf_check_t[
+    (  ((int)KDF_PBKDF2_SHA1   == (int)GPW_KDF_PBKDF2_SHA1)
+    && ((int)KDF_PBKDF2_SHA256 == (int)GPW_KDF_PBKDF2_SHA256)
+    && ((int)KDF_PBKDF2_SHA512 == (int)GPW_KDF_PBKDF2_SHA512)
+    && ((int)KDF_ARGON2ID      == (int)GPW_KDF_ARGON2ID)) ? 1 : -1];
+
+#define KDF_BENCH_CT  3
+
+////PULL-HEADERS:
+
+/**
+ * Parse an Argon2 cost specification:  passes, KiB and lanes,
+ * separated by commas.
+ *
+ * @param str   the specification
+ * @param prm   where to put the values.  Nothing else is touched.
+ * @returns false if the text is malformed or a value is out of range
+ */
+static bool
+parse_argon2_cost(char const * str, gpw_params_t * prm)
+{
+    unsigned long val[3];
+    int ix;
+
+    for (ix = 0; ix < 3; ix++) {
+        char * end;
+
+        while (isspace((unsigned int)*str))  str++;
+        if (! isdigit((unsigned int)*str))
+            return false;
+
+        errno   = 0;
+        val[ix] = strtoul(str, &end, 10);
+        if (errno != 0)
+            return false;
+
+        str = end;
+        while (isspace((unsigned int)*str))  str++;
+        if (*(str++) != ((ix < 2) ? ',' : NUL))
+            return false;
+    }
+
+    if (  (val[0] < 1) || (val[0] > GPW_ARGON2_MAX_PASSES)
+       || (val[2] < 1) || (val[2] > GPW_ARGON2_MAX_LANES)
+       || (val[1] < 8 * val[2]) || (val[1] > GPW_ARGON2_MAX_MEM_KIB))
+        return false;
+
+    prm->gp_passes  = (unsigned int)val[0];
+    prm->gp_mem_kib = (unsigned int)val[1];
+    prm->gp_lanes   = (unsigned int)val[2];
+    return true;
+}
+
+/**
+ * Fill in the derivation context for a password id from the option
+ * settings.  This is done once, after the stored options for the
+ * password id are set.  The seed is left NULL:  callers fill in
+ * \a gp_tag and \a gp_text for each seed.  Nothing after this reads
+ * the option state to derive or fix up a password.
+ *
+ * @param[out] prm   the derivation context
+ * @param[in]  pwid  the password id
+ */
+static void
+set_pw_params(gpw_params_t * prm, char const * pwid)
+{
+    gpw_params_init(prm);
+    prm->gp_pwid     = pwid;
+    prm->gp_confirm  = HAVE_OPT(CONFIRM) ? OPT_ARG(CONFIRM) : NULL;
+    prm->gp_specials = OPT_ARG(SPECIALS);
+    prm->gp_length   = (unsigned int)OPT_VALUE_LENGTH;
+    prm->gp_cclass   = (uint32_t)OPT_VALUE_CCLASS;
+    prm->gp_kdf      = (gpw_kdf_t)OPT_VALUE_KDF;
+    prm->gp_rehash   = ENABLED_OPT(PBKDF2) ? (unsigned long)OPT_VALUE_PBKDF2 : 0;
+
+    if (! parse_argon2_cost(OPT_ARG(ARGON2_COST), prm))
+        die(GNU_PW_MGR_EXIT_INVALID, bad_argon2_cost_fmt,
+            OPT_ARG(ARGON2_COST));
+}
+
+/**
+ * Check the result of a library call.  It returns only on success.
+ *
+ * @param rc   the result code
+ * @param prm  the parameters that were used
+ */
+static void
+check_gpw_rc(gpw_err_t rc, gpw_params_t const * prm)
+{
+    switch (rc) {
+    case GPW_OK:
+        return;
+
+    case GPW_ERR_PIN_LENGTH:
+        die(GNU_PW_MGR_EXIT_INVALID, pin_too_big,
+            prm->gp_length, gpw_max_length(prm));
+        /* NOTREACHED */
+
+    default:
+        die(GNU_PW_MGR_EXIT_INVALID, gpw_err_fmt,
+            prm->gp_pwid, gpw_strerror(rc));
+    }
+}
+
+/**
+ * Self test and time every key derivation function.  Each is timed
+ * deriving a default length password hash with the default iteration
+ * count.  Argon2 uses the "--argon2-cost" value.
+ * If any self test fails, we exit with a coding error.
+ */
+static void
+kdf_bench(void)
+{
+    static char const bench_salt[] =
+        "This is only a test.  Were it real, you would likely know.";
+
+    bool         all_ok = true;
+    gpw_params_t prm;
+    int          kdf;
+
+    set_pw_params(&prm, "bench id");
+    prm.gp_tag     = "bench tag";
+    prm.gp_text    = bench_salt;
+    prm.gp_confirm = NULL;
+    prm.gp_length  = GPW_DFT_LENGTH;
+    prm.gp_rehash  = GPW_DFT_REHASH;
+    printf(kdf_bench_hdr, "kdf", "test", "cost", "msec");
+
+    for (kdf = GPW_KDF_SHA256; kdf < GPW_KDF_CT; kdf++) {
+        unsigned char out[GPW_HASH_MAX];
+        struct timespec start, end;
+        double msec;
+        bool   ok = gpw_kdf_self_test((gpw_kdf_t)kdf);
+        int    ct = KDF_BENCH_CT;
+
+        all_ok    &= ok;
+        prm.gp_kdf = (gpw_kdf_t)kdf;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do  {
+            if (gpw_derive_hash(&prm, out, sizeof(out)) != GPW_OK)
+                ok = all_ok = false;
+        } while (--ct > 0);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        msec = ((end.tv_sec - start.tv_sec) * 1000.0)
+            + ((end.tv_nsec - start.tv_nsec) / 1000000.0);
+        printf(kdf_bench_fmt, gpw_kdf_name((gpw_kdf_t)kdf),
+               ok ? "ok" : "FAILED",
+               (kdf == GPW_KDF_SHA256) ? 0UL : prm.gp_rehash,
+               msec / KDF_BENCH_CT);
+    }
+
+    if (! all_ok)
+        die(GNU_PW_MGR_EXIT_CODING_ERROR, kdf_test_fail);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of kdf-opts.c */
@@ -0,0 +1,366 @@
+/**
+ * @file kdf.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Self test vectors.  The PBKDF2 values are from RFC 6070 and its
+ * widely published SHA-256 and SHA-512 counterparts.  The Argon2id
+ * values were computed with the reference implementation, passing the
+ * iteration count as four bytes of little endian associated data.
+ * The RFC 9106 vector is checked by argon2_self_test().
+ */
+static kdf_vector_t const sha256_tests[] = {
+    { "abc", "", { .kc_iter = 0 },
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+    { NULL, NULL, { 0 }, NULL }
+};
+
+static kdf_vector_t const pbkdf2_sha1_tests[] = {
+    { "password", "salt", { .kc_iter = 1 },
+      "0c60c80f961f0e71f3a9b524af6012062fe037a6" },
+    { "password", "salt", { .kc_iter = 2 },
+      "ea6c014dc72d6f8ccd1ed92ace1d41f0d8de8957" },
+    { NULL, NULL, { 0 }, NULL }
+};
+
+static kdf_vector_t const pbkdf2_sha256_tests[] = {
+    { "password", "salt", { .kc_iter = 1 },
+      "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b" },
+    { "password", "salt", { .kc_iter = 2 },
+      "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43" },
+    { NULL, NULL, { 0 }, NULL }
+};
+
+static kdf_vector_t const pbkdf2_sha512_tests[] = {
+    { "password", "salt", { .kc_iter = 1 },
+      "867f70cf1ade02cff3752599a3a53dc4af34c7a669815ae5d513554e1c8cf252"
+      "c02d470a285a0501bad999bfe943c08f050235d7d68b1da55e63f73b60a57fce" },
+    { NULL, NULL, { 0 }, NULL }
+};
+
+static kdf_vector_t const argon2id_tests[] = {
+    { "password", "somesalt", { 1, 2, 64, 2, 0 },
+      "69e1fa2f0bfab45ed63cd32f2f483d98d91dd86d9ba3ca660ac8bc495eb298e0" },
+    { "password", "somesalt", { 10007, 1, 32, 4, 0 },
+      "e2d93044e111db9394ebeae778f9a9a33100a05b755636596e50f8214f574fee" },
+    { NULL, NULL, { 0 }, NULL }
+};
+
+/*
+ * The registered key derivation backends.  The first entry is the
+ * original glue-the-text-together-and-hash method, used when rehashing
+ * is disabled or the password is too long for it.  The remaining entries
+ * are indexed by the gpw_kdf_t value (plus one), which is the order of
+ * the "--kdf" keywords in opts.def.
+ */
+static kdf_backend_t const kdf_table[] = {
+    [1 + GPW_KDF_SHA256] = {
+      .kb_name     = "sha256",
+      .kb_prf      = kdf_sha256,
+      .kb_hash     = GC_SHA256,
+      .kb_out_len  = 256 / NBBY,
+      .kb_tests    = sha256_tests },
+
+    [1 + GPW_KDF_PBKDF2_SHA1] = {
+      .kb_name     = "pbkdf2-sha1",
+      .kb_prf      = kdf_pbkdf2,
+      .kb_hash     = GC_SHA1,
+      .kb_flags    = KDF_SALTED,
+      .kb_tests    = pbkdf2_sha1_tests },
+
+    [1 + GPW_KDF_PBKDF2_SHA256] = {
+      .kb_name     = "pbkdf2-sha256",
+      .kb_prf      = kdf_pbkdf2,
+      .kb_hash     = GC_SHA256,
+      .kb_flags    = KDF_SALTED,
+      .kb_tests    = pbkdf2_sha256_tests },
+
+    [1 + GPW_KDF_PBKDF2_SHA512] = {
+      .kb_name     = "pbkdf2-sha512",
+      .kb_prf      = kdf_pbkdf2,
+      .kb_hash     = GC_SHA512,
+      .kb_flags    = KDF_SALTED,
+      .kb_tests    = pbkdf2_sha512_tests },
+
+    [1 + GPW_KDF_ARGON2ID] = {
+      .kb_name     = "argon2id",
+      .kb_prf      = kdf_argon2id,
+      .kb_flags    = KDF_SALTED,
+      .kb_tests    = argon2id_tests,
+      .kb_check    = argon2_self_test }
+};
+
+#define KDF_TABLE_CT  (sizeof(kdf_table) / sizeof(kdf_table[0]))
+
+/*
+ * Salted derivations produce enough hash for the longest password that
+ * uses them (KDF_MAX_PW_LEN characters) with some to spare.  This is
+ * what gnu-pw-mgr has always used, and Argon2 results depend on it.
+ */
+#define KDF_SALTED_OUT_LEN  (4 + ((MIN_BUF_LEN * 6) >> 3))
+
+/*
+ * Hash sources up to this size are assembled on the stack.
+ * Seed texts are rarely more than a few hundred bytes.
+ */
+#define KDF_SRC_BUF_LEN     1024
+
+////LIB-HEADERS:
+
+/**
+ * The original method: a plain sha256 sum of the hash source.
+ * The salt and cost are ignored.
+ */
+static int
+kdf_sha256(kdf_backend_t const * kdf,
+           char const * pw,   size_t pw_len,
+           char const * salt, size_t salt_len,
+           kdf_cost_t const * cost,
+           unsigned char * out, size_t out_len)
+{
+    struct sha256_ctx ctx;
+
+    if (out_len < kdf->kb_out_len)
+        return GC_INVALID_HASH;
+
+    sha256_init_ctx(&ctx);
+    sha256_process_bytes(pw, pw_len, &ctx);
+    sha256_finish_ctx(&ctx, out);
+    (void)salt; (void)salt_len; (void)cost;
+    return GC_OK;
+}
+
+/**
+ * Password Based Key Derivation Function, version 2,
+ * with the HMAC hash selected by the backend.
+ */
+static int
+kdf_pbkdf2(kdf_backend_t const * kdf,
+           char const * pw,   size_t pw_len,
+           char const * salt, size_t salt_len,
+           kdf_cost_t const * cost,
+           unsigned char * out, size_t out_len)
+{
+    return gc_pbkdf2_hmac((Gc_hash)kdf->kb_hash, pw, pw_len, salt, salt_len,
+                          (unsigned int)cost->kc_iter, (char *)out, out_len);
+}
+
+/**
+ * Argon2id.  The iteration count is not a cost for this function,
+ * but it must still change the result, so it is passed as the
+ * associated data.
+ */
+static int
+kdf_argon2id(kdf_backend_t const * kdf,
+             char const * pw,   size_t pw_len,
+             char const * salt, size_t salt_len,
+             kdf_cost_t const * cost,
+             unsigned char * out, size_t out_len)
+{
+    unsigned char ad[4];
+
+    store32_le(ad, (uint32_t)cost->kc_iter);
+    (void)kdf;
+    return argon2id_hash(out, out_len, pw, pw_len, salt, salt_len,
+                         NULL, 0, ad, sizeof(ad),
+                         cost->kc_passes, cost->kc_mem_kib, cost->kc_lanes,
+                         cost->kc_threads, ARGON2_IMPL_OPT);
+}
+
+/**
+ * Select the key derivation backend for a password.  Use the selected
+ * function if rehashing is enabled and the password is not longer than
+ * what we can provide with 256 bits of hash (40 bytes).
+ *
+ * @param prm  the derivation parameters
+ * @returns the backend table entry, or NULL if the function is unknown
+ */
+static kdf_backend_t const *
+kdf_select(gpw_params_t const * prm)
+{
+    if (  (prm->gp_rehash == 0)
+       || (prm->gp_kdf == GPW_KDF_SHA256)
+       || (prm->gp_length > KDF_MAX_PW_LEN))
+        return kdf_table;
+
+    if ((prm->gp_kdf < GPW_KDF_SHA256) || (prm->gp_kdf >= GPW_KDF_CT))
+        return NULL;
+
+    return kdf_table + 1 + prm->gp_kdf;
+}
+
+/**
+ * @param kdf  the selected backend
+ * @returns the number of hash bytes derived with \a kdf
+ */
+static size_t
+kdf_hash_len(kdf_backend_t const * kdf)
+{
+    if (kdf->kb_out_len != 0)
+        return kdf->kb_out_len;
+    return KDF_SALTED_OUT_LEN;
+}
+
+/**
+ * Assemble the hash source for a key derivation:  the seed tag, the seed
+ * text (unless it is the salt), the password id and the confirmation
+ * question, if any, each with its NUL terminator.  It is put in \a buf
+ * if it fits, so the usual derivation does not touch the heap.
+ *
+ * @param[in]  kdf          the selected backend
+ * @param[in]  prm          the derivation parameters
+ * @param[in]  buf          a buffer for the source
+ * @param[in]  buf_size     its size
+ * @param[out] src_len      the source length
+ * @returns \a buf or an allocated source, or NULL
+ */
+static char *
+kdf_source(kdf_backend_t const * kdf, gpw_params_t const * prm,
+           char * buf, size_t buf_size, size_t * src_len)
+{
+    size_t const stag_len = strlen(prm->gp_tag) + 1;
+    size_t const text_len = strlen(prm->gp_text) + 1;
+    size_t const pwid_len = strlen(prm->gp_pwid) + 1;
+    size_t const conf_len =
+        (prm->gp_confirm != NULL) ? (strlen(prm->gp_confirm) + 1) : 0;
+    bool const   salted   = (kdf->kb_flags & KDF_SALTED) != 0;
+
+    size_t const src_size =
+        stag_len + pwid_len + conf_len + (salted ? 0 : text_len);
+    char * const src      = (src_size <= buf_size) ? buf : malloc(src_size);
+    char *       scan     = src;
+
+    if (src == NULL)
+        return NULL;
+
+    memcpy(scan, prm->gp_tag, stag_len);
+    scan += stag_len;
+
+    if (! salted) {
+        memcpy(scan, prm->gp_text, text_len);
+        scan += text_len;
+    }
+
+    memcpy(scan, prm->gp_pwid, pwid_len);
+    scan += pwid_len;
+
+    if (conf_len > 0) {
+        memcpy(scan, prm->gp_confirm, conf_len);
+        scan += conf_len;
+    }
+
+    *src_len = scan - src;
+    return src;
+}
+
+/**
+ * hash the seed tag, the seed text and the password id (and confirmation
+ * question, if any) with the selected key derivation function.
+ *
+ * @param kdf          the selected backend
+ * @param prm          the derivation parameters
+ * @param out          result buffer
+ * @param out_len      the number of hash bytes wanted
+ * @returns GPW_OK, or the reason for failure
+ */
+static gpw_err_t
+kdf_derive(kdf_backend_t const * kdf, gpw_params_t const * prm,
+           unsigned char * out, size_t out_len)
+{
+    bool const   salted   = (kdf->kb_flags & KDF_SALTED) != 0;
+    kdf_cost_t   cost     = {
+        .kc_iter    = prm->gp_rehash,
+        .kc_passes  = prm->gp_passes,
+        .kc_mem_kib = prm->gp_mem_kib,
+        .kc_lanes   = prm->gp_lanes,
+        .kc_threads = prm->gp_threads };
+    char         src_buf[KDF_SRC_BUF_LEN];
+    size_t       src_len;
+    char *       src      =
+        kdf_source(kdf, prm, src_buf, sizeof(src_buf), &src_len);
+    int          rc;
+
+    if (src == NULL)
+        return GPW_ERR_NO_MEM;
+
+    rc = kdf->kb_prf(kdf, src, src_len,
+                     salted ? prm->gp_text : NULL,
+                     salted ? (strlen(prm->gp_text) + 1) : 0,
+                     &cost, out, out_len);
+    memset(src, 0, src_len);
+    if (src != src_buf)
+        free(src);
+
+    switch (rc) {
+    case GC_OK:             return GPW_OK;
+    case GC_MALLOC_ERROR:   return GPW_ERR_NO_MEM;
+    default:                return GPW_ERR_KDF;
+    }
+}
+
+/**
+ * Run the self test vectors for one backend.
+ *
+ * @param kdf  the backend to test
+ * @returns true if all the vectors produced the expected output
+ */
+static bool
+kdf_self_test(kdf_backend_t const * kdf)
+{
+    static char const hex_digits[] = "0123456789abcdef";
+    kdf_vector_t const * kv = kdf->kb_tests;
+
+    for (; kv->kv_pw != NULL; kv++) {
+        unsigned char out[512 / NBBY];
+        char          hex[sizeof(out) * 2 + 1];
+        size_t        out_len = strlen(kv->kv_hex) / 2;
+        size_t        ix;
+
+        if (out_len > sizeof(out))
+            return false;
+
+        if (kdf->kb_prf(kdf, kv->kv_pw, strlen(kv->kv_pw),
+                        kv->kv_salt, strlen(kv->kv_salt),
+                        &kv->kv_cost, out, out_len) != GC_OK)
+            return false;
+
+        for (ix = 0; ix < out_len; ix++) {
+            hex[ix * 2]     = hex_digits[out[ix] >> 4];
+            hex[ix * 2 + 1] = hex_digits[out[ix] & 0x0F];
+        }
+        hex[out_len * 2] = NUL;
+
+        if (strcmp(hex, kv->kv_hex) != 0)
+            return false;
+    }
+
+    return (kdf->kb_check == NULL) || kdf->kb_check();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of kdf.c */
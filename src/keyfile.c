@@ -0,0 +1,142 @@
+/**
+ * @file keyfile.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Key files are expanded from the derived hash in counter mode:
+ * block N is the sha256 sum of the label "gnu-pw-mgr keyfile" with its
+ * NUL byte, the hash, and N as a 32 bit big endian number.  The label
+ * keeps key material apart from any other use of the same hash.  The
+ * output is written a chunk at a time, so the size is not limited by
+ * the password buffer.
+ */
+
+#define KEYFILE_BLOCK_SIZE  (256 / NBBY)
+#define KEYFILE_CHUNK_SIZE  (64 * 1024)
+
+////PULL-HEADERS:
+
+/**
+ * Write all of a buffer to a file descriptor.  It succeeds or dies.
+ *
+ * @param fd   the output file descriptor
+ * @param buf  the data
+ * @param len  the data length
+ */
+static void
+keyfile_write(int fd, char const * buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t wrlen = write(fd, buf, len);
+        if (wrlen < 0) {
+            if (errno == EINTR)
+                continue;
+            fserr(GNU_PW_MGR_EXIT_INVALID, "write", stdin_out_z);
+        }
+        buf += wrlen;
+        len -= (size_t)wrlen;
+    }
+}
+
+/**
+ * Write \a OPT_VALUE_KEYFILE bytes of key material for a password id to
+ * standard output.  The first usable seed is used.  The sha256 state
+ * after hashing the label and the derived key is computed once and
+ * copied for each block, so only the counter is hashed per block.
+ *
+ * The password length is not used, but a length longer than
+ * GPW_KDF_MAX_LENGTH would select the plain sha256 sum instead of the
+ * key derivation function.  It is limited to that, so the key material
+ * always gets the stretching chosen for the password id.
+ *
+ * @param pwid_prm  the derivation context of the password id
+ */
+static void
+print_keyfile(gpw_params_t const * pwid_prm)
+{
+    tOptionValue const * ov  = optionFindValue(&DESC(SEED), NULL, NULL);
+    size_t               rem = (size_t)OPT_VALUE_KEYFILE;
+    gpw_params_t         prm = *pwid_prm;
+
+    if (prm.gp_length > GPW_KDF_MAX_LENGTH)
+        prm.gp_length = GPW_KDF_MAX_LENGTH;
+
+    for (;;) {
+        if (usable_seed(ov, &prm.gp_tag, &prm.gp_text))
+            break;
+        ov = optionFindNextValue(&DESC(SEED), ov, NULL, NULL);
+        if (ov == NULL)
+            die(GNU_PW_MGR_EXIT_NO_SEED, no_passwords,
+                ENABLED_OPT(SHARED) ? sec_pw_type : "");
+    }
+
+    {
+        char *            chunk = scribble_get(KEYFILE_CHUNK_SIZE);
+        unsigned char     hash[GPW_HASH_MAX];
+        struct sha256_ctx base;
+        uint32_t          ctr = 0;
+
+        check_gpw_rc(gpw_derive_hash(&prm, hash, sizeof(hash)), &prm);
+        sha256_init_ctx(&base);
+        sha256_process_bytes(keyfile_label, keyfile_label_LEN + 1, &base);
+        sha256_process_bytes(hash, gpw_hash_len(&prm), &base);
+        memset(hash, 0, sizeof(hash));
+
+        while (rem > 0) {
+            size_t const chunk_len =
+                (rem > KEYFILE_CHUNK_SIZE) ? KEYFILE_CHUNK_SIZE : rem;
+            size_t off;
+
+            for (off = 0; off < chunk_len; off += KEYFILE_BLOCK_SIZE) {
+                struct sha256_ctx ctx = base;
+                unsigned char     ctr_buf[4] = {
+                    (unsigned char)(ctr >> 24), (unsigned char)(ctr >> 16),
+                    (unsigned char)(ctr >>  8), (unsigned char)ctr };
+                ctr++;
+
+                sha256_process_bytes(ctr_buf, sizeof(ctr_buf), &ctx);
+                if (chunk_len - off >= KEYFILE_BLOCK_SIZE)
+                    sha256_finish_ctx(&ctx, chunk + off);
+
+                else {
+                    char last[KEYFILE_BLOCK_SIZE];
+                    sha256_finish_ctx(&ctx, last);
+                    memcpy(chunk + off, last, chunk_len - off);
+                    memset(last, 0, sizeof(last));
+                }
+            }
+
+            keyfile_write(STDOUT_FILENO, chunk, chunk_len);
+            rem -= chunk_len;
+        }
+
+        memset(chunk, 0, KEYFILE_CHUNK_SIZE);
+        memset(&base, 0, sizeof(base));
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of keyfile.c */
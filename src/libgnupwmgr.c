@@ -0,0 +1,335 @@
+/**
+ * @file libgnupwmgr.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The entry points of the password derivation library.  Nothing here
+ * touches the option state or any other global data, so the functions
+ * may be called from any number of threads at once.
+ */
+
+#include "lib-fwd.h"
+
+static char const * const gpw_err_names[GPW_ERR_CT] = {
+    [GPW_OK]             = "success",
+    [GPW_ERR_INVALID]    = "invalid derivation parameter",
+    [GPW_ERR_LENGTH]     = "invalid password length for the character classes",
+    [GPW_ERR_PIN_LENGTH] = "PIN length exceeds what the hash can provide",
+    [GPW_ERR_BUF_SIZE]   = "output buffer too small",
+    [GPW_ERR_NO_MEM]     = "out of memory",
+    [GPW_ERR_KDF]        = "key derivation failed",
+    [GPW_ERR_SPECIALS]   = "the special characters cannot meet the classes"
+};
+
+#define GPW_PIN_BITS    (GPW_CCLASS_NO_ALPHA | GPW_CCLASS_NO_SPECIAL)
+
+////LIB-HEADERS:
+
+/**
+ * Replace the character classes "pin" and "alnum" with the bits they
+ * stand for, and set digit/upper/lower when two of them are required.
+ * This is what the "--cclass" option handling does.
+ *
+ * @param[in,out] bits  the GPW_CCLASS_* bits
+ * @returns false if "pin" and "alnum" are both set
+ */
+static bool
+lib_fix_cclass(uint32_t * bits)
+{
+    uint32_t cc = *bits;
+
+    if (cc & GPW_CCLASS_TWO_DIGIT)
+        cc |= GPW_CCLASS_DIGIT;
+
+    if (cc & GPW_CCLASS_TWO_UPPER)
+        cc |= GPW_CCLASS_UPPER;
+
+    if (cc & GPW_CCLASS_TWO_LOWER)
+        cc |= GPW_CCLASS_LOWER;
+
+    if ((cc & GPW_CCLASS_ALPHA) && (cc & (GPW_CCLASS_UPPER | GPW_CCLASS_LOWER)))
+        cc &= ~GPW_CCLASS_ALPHA;
+
+    switch (cc & (GPW_CCLASS_PIN | GPW_CCLASS_ALNUM)) {
+    case 0:
+        break;
+
+    case GPW_CCLASS_PIN:
+        cc |= GPW_PIN_BITS;
+        break;
+
+    case GPW_CCLASS_ALNUM:
+        if (cc & (GPW_CCLASS_UPPER | GPW_CCLASS_LOWER))
+            cc |= GPW_CCLASS_DIGIT;
+        else
+            cc |= GPW_CCLASS_ALPHA | GPW_CCLASS_DIGIT;
+        break;
+
+    default:
+        return false;
+    }
+
+    *bits = cc & ~(GPW_CCLASS_PIN | GPW_CCLASS_ALNUM);
+    return true;
+}
+
+/**
+ * PIN numbers are made by converting the hash, one word at a time,
+ * into decimal digits.
+ *
+ * @param d_len  the length of the raw hash
+ * @returns the longest PIN number that can be made from it
+ */
+static size_t
+lib_pin_max_len(size_t d_len)
+{
+    static uint32_t const bytes_per_val = 7
+#if SIZEOF_CHARP > 4
+        + 10
+#endif
+        ;
+
+    return (d_len / sizeof(uintptr_t)) * bytes_per_val;
+}
+
+/**
+ * Check the Argon2 costs.  They are only used by Argon2id.
+ *
+ * @param prm  the derivation parameters
+ * @returns true if they are in range
+ */
+static bool
+lib_argon2_cost_ok(gpw_params_t const * prm)
+{
+    return (prm->gp_passes >= 1) && (prm->gp_passes <= ARGON2_MAX_PASSES)
+        && (prm->gp_lanes  >= 1) && (prm->gp_lanes  <= ARGON2_MAX_LANES)
+        && (prm->gp_mem_kib >= 8 * prm->gp_lanes)
+        && (prm->gp_mem_kib <= ARGON2_MAX_MEM_KIB);
+}
+
+void
+gpw_params_init(gpw_params_t * prm)
+{
+    memset(prm, 0, sizeof(*prm));
+    prm->gp_length  = GPW_DFT_LENGTH;
+    prm->gp_cclass  = GPW_CCLASS_DEFAULT;
+    prm->gp_kdf     = GPW_KDF_PBKDF2_SHA1;
+    prm->gp_rehash  = GPW_DFT_REHASH;
+    prm->gp_passes  = GPW_ARGON2_DFT_PASSES;
+    prm->gp_mem_kib = GPW_ARGON2_DFT_MEM_KIB;
+    prm->gp_lanes   = GPW_ARGON2_DFT_LANES;
+}
+
+size_t
+gpw_hash_len(gpw_params_t const * prm)
+{
+    kdf_backend_t const * kdf = kdf_select(prm);
+    return (kdf == NULL) ? 0 : kdf_hash_len(kdf);
+}
+
+gpw_err_t
+gpw_derive_hash(gpw_params_t const * prm, unsigned char * hash,
+                size_t hash_len)
+{
+    kdf_backend_t const * kdf;
+
+    if (  (prm == NULL) || (hash == NULL)
+       || (prm->gp_tag == NULL) || (prm->gp_text == NULL)
+       || (prm->gp_pwid == NULL) || (prm->gp_rehash > GPW_MAX_REHASH))
+        return GPW_ERR_INVALID;
+
+    kdf = kdf_select(prm);
+    if (kdf == NULL)
+        return GPW_ERR_INVALID;
+
+    if ((kdf->kb_prf == kdf_argon2id) && ! lib_argon2_cost_ok(prm))
+        return GPW_ERR_INVALID;
+
+    if (hash_len < kdf_hash_len(kdf))
+        return GPW_ERR_BUF_SIZE;
+
+    return kdf_derive(kdf, prm, hash, kdf_hash_len(kdf));
+}
+
+gpw_err_t
+gpw_encode(gpw_params_t const * prm, unsigned char const * hash,
+           size_t hash_len, char * pw, size_t pw_size)
+{
+    char const * spec;
+    uint32_t     cclass;
+    size_t       len;
+
+    if ((prm == NULL) || (hash == NULL) || (pw == NULL)
+       || (hash_len < 256 / NBBY))
+        return GPW_ERR_INVALID;
+
+    cclass = prm->gp_cclass;
+    spec   = (prm->gp_specials != NULL) ? prm->gp_specials : GPW_DFT_SPECIALS;
+    len    = prm->gp_length;
+    if (! lib_fix_cclass(&cclass) || (strlen(spec) != 3))
+        return GPW_ERR_INVALID;
+
+    if ((len < GPW_MIN_LENGTH) || (len > GPW_MAX_LENGTH))
+        return GPW_ERR_LENGTH;
+
+    if (pw_size <= len)
+        return GPW_ERR_BUF_SIZE;
+
+    /*
+     * Check for PIN number password.  The digits are made from words
+     * of the hash, so copy it to get the alignment right.
+     */
+    if ((cclass & GPW_PIN_BITS) == GPW_PIN_BITS) {
+        uintptr_t sums[GPW_HASH_MAX / sizeof(uintptr_t)] = { 0 };
+
+        if (len > lib_pin_max_len(hash_len))
+            return GPW_ERR_PIN_LENGTH;
+
+        memcpy(sums, hash, (hash_len > sizeof(sums)) ? sizeof(sums) : hash_len);
+        fix_digit_pw(pw, sums, len);
+        memset(sums, 0, sizeof(sums));
+        return GPW_OK;
+    }
+
+    if (len < GPW_MIN_PW_LENGTH)
+        return GPW_ERR_LENGTH;
+
+    b64_encode((char const *)hash, hash_len, pw, pw_size);
+    pw[len] = NUL;
+
+    if ((cclass & GPW_PIN_BITS) == GPW_CCLASS_NO_ALPHA)
+        fix_no_alpha_pw(pw, cclass, spec);
+    else if (! fix_std_pw(pw, cclass, spec))
+        return GPW_ERR_SPECIALS;
+
+    return GPW_OK;
+}
+
+gpw_err_t
+gpw_derive(gpw_params_t const * prm, char * pw, size_t pw_size)
+{
+    unsigned char hash[GPW_HASH_MAX];
+    gpw_err_t     rc = gpw_derive_hash(prm, hash, sizeof(hash));
+
+    if (rc == GPW_OK)
+        rc = gpw_encode(prm, hash, gpw_hash_len(prm), pw, pw_size);
+    memset(hash, 0, sizeof(hash));
+    return rc;
+}
+
+gpw_err_t
+gpw_confirm_answer(gpw_params_t const * prm, unsigned char const * hash,
+                   size_t hash_len, char * answer, size_t answer_size)
+{
+    unsigned char sum[256 / NBBY];
+
+    if (  (prm == NULL) || (answer == NULL)
+       || (prm->gp_pwid == NULL) || (prm->gp_confirm == NULL))
+        return GPW_ERR_INVALID;
+
+    if (answer_size <= GPW_CONFIRM_LEN)
+        return GPW_ERR_BUF_SIZE;
+
+    /*
+     * Unless the caller wants the old style, changeable answer made from
+     * the derived hash, compute a new hash based only on the password id
+     * string and the confirmation text.
+     */
+    if (hash == NULL) {
+        struct sha256_ctx ctx;
+
+        sha256_init_ctx(&ctx);
+        sha256_process_bytes(prm->gp_pwid, strlen(prm->gp_pwid) + 1, &ctx);
+        sha256_process_bytes(prm->gp_confirm, strlen(prm->gp_confirm) + 1,
+                             &ctx);
+        sha256_finish_ctx(&ctx, sum);
+
+        hash     = sum;
+        hash_len = sizeof(sum);
+    }
+
+    b64_encode((char const *)hash, hash_len, answer, GPW_CONFIRM_LEN + 1);
+    answer[GPW_CONFIRM_LEN] = NUL;
+    fix_lower_only_pw(answer);
+    memset(sum, 0, sizeof(sum));
+    return GPW_OK;
+}
+
+unsigned int
+gpw_max_length(gpw_params_t const * prm)
+{
+    uint32_t cclass = prm->gp_cclass;
+    size_t   max_len;
+
+    if (! lib_fix_cclass(&cclass) || ((cclass & GPW_PIN_BITS) != GPW_PIN_BITS))
+        return GPW_MAX_LENGTH;
+
+    max_len = lib_pin_max_len(gpw_hash_len(prm));
+    return (max_len > GPW_MAX_LENGTH) ? GPW_MAX_LENGTH : (unsigned int)max_len;
+}
+
+gpw_kdf_t
+gpw_kdf_used(gpw_params_t const * prm)
+{
+    kdf_backend_t const * kdf = kdf_select(prm);
+
+    if (kdf == NULL)
+        return GPW_KDF_CT;
+    return (gpw_kdf_t)((kdf - kdf_table) - 1);
+}
+
+char const *
+gpw_kdf_name(gpw_kdf_t kdf)
+{
+    if ((kdf < GPW_KDF_SHA256) || (kdf >= GPW_KDF_CT))
+        return NULL;
+    return kdf_table[1 + kdf].kb_name;
+}
+
+bool
+gpw_kdf_self_test(gpw_kdf_t kdf)
+{
+    if ((kdf < GPW_KDF_SHA256) || (kdf >= GPW_KDF_CT))
+        return false;
+    return kdf_self_test(kdf_table + 1 + kdf);
+}
+
+void
+gpw_base64_encode(void const * in, size_t inlen, char * out, size_t outlen)
+{
+    b64_encode(in, inlen, out, outlen);
+}
+
+char const *
+gpw_strerror(gpw_err_t err)
+{
+    if ((unsigned int)err >= GPW_ERR_CT)
+        return "unknown error";
+    return gpw_err_names[err];
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of libgnupwmgr.c */
@@ -0,0 +1,164 @@
+/**
+ * @file parallel.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Run a set of independent jobs on as many processors as are available.
+ * The job functions must not touch the option state:  it is not thread
+ * safe.  Assemble inputs before and consume the results after.  Jobs may
+ * use scribble space.  Each thread has its own, and whatever a job
+ * allocates is released when it returns, so it must not hold results.
+ * Without thread local storage, the jobs are run in the calling thread.
+ */
+
+#if defined(HAVE_PTHREAD_H) && defined(THREAD_LOCAL)
+# define PARALLEL_THREADS 1
+# include <pthread.h>
+
+typedef struct {
+    pthread_mutex_t     pl_lock;
+    size_t              pl_next;
+    size_t              pl_ct;
+    parallel_fn_t *     pl_fn;
+    void *              pl_ctx;
+} parallel_pool_t;
+#endif
+
+#define PARALLEL_MAX_THREADS  64
+
+////PULL-HEADERS:
+
+#ifdef PARALLEL_THREADS
+/**
+ * @returns the number of processors available, at least one.
+ */
+static unsigned int
+parallel_cpu_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long ct = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ct > PARALLEL_MAX_THREADS)
+        return PARALLEL_MAX_THREADS;
+    if (ct > 1)
+        return (unsigned int)ct;
+#endif
+    return 1;
+}
+
+/**
+ * Claim the next job until there are none left.
+ *
+ * @param pool  the jobs
+ */
+static void
+parallel_run(parallel_pool_t * pool)
+{
+    for (;;) {
+        scribble_mark_t mk;
+        size_t ix;
+
+        pthread_mutex_lock(&pool->pl_lock);
+        ix = pool->pl_next;
+        if (ix < pool->pl_ct)
+            pool->pl_next++;
+        pthread_mutex_unlock(&pool->pl_lock);
+
+        if (ix >= pool->pl_ct)
+            return;
+        mk = scribble_mark();
+        pool->pl_fn(pool->pl_ctx, ix);
+        scribble_release(mk);
+    }
+}
+
+/**
+ * Thread start routine:  run jobs, then release the thread's scribble
+ * space.
+ */
+static void *
+parallel_worker(void * arg)
+{
+    scribble_init();
+    parallel_run(arg);
+    scribble_deinit();
+    return NULL;
+}
+#endif // PARALLEL_THREADS
+
+/**
+ * Call \a fn for each job index from zero to \a ct - 1, spread over
+ * the available processors.  Returns when all the jobs are done.
+ * If threads cannot be started, the remaining jobs are run here.
+ *
+ * @param ct   the number of jobs
+ * @param fn   the job function
+ * @param ctx  the job context, passed through to \a fn
+ */
+static void
+parallel_for(size_t ct, parallel_fn_t * fn, void * ctx)
+{
+#ifdef PARALLEL_THREADS
+    unsigned int thr_ct = parallel_cpu_count();
+
+    if ((thr_ct > 1) && (ct > 1)) {
+        pthread_t       tid[PARALLEL_MAX_THREADS];
+        parallel_pool_t pool = {
+            .pl_next = 0, .pl_ct = ct, .pl_fn = fn, .pl_ctx = ctx };
+        unsigned int    started = 0;
+
+        if (thr_ct > ct)
+            thr_ct = (unsigned int)ct;
+
+        pthread_mutex_init(&pool.pl_lock, NULL);
+        while (started < thr_ct) {
+            if (pthread_create(tid + started, NULL, parallel_worker,
+                               &pool) != 0)
+                break;
+            started++;
+        }
+
+        /*
+         * Help out (or do everything, if no thread could be started).
+         */
+        parallel_run(&pool);
+        while (started > 0)
+            pthread_join(tid[--started], NULL);
+        pthread_mutex_destroy(&pool.pl_lock);
+        return;
+    }
+#endif // PARALLEL_THREADS
+    {
+        size_t ix;
+        for (ix = 0; ix < ct; ix++) {
+            scribble_mark_t mk = scribble_mark();
+            fn(ctx, ix);
+            scribble_release(mk);
+        }
+    }
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of parallel.c */
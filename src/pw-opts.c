@@ -42,7 +42,7 @@ make_pwid_mark(char const * name, size_t * len)
     sha256_init_ctx(&ctx);
     sha256_process_bytes(name, strlen(name)+1, &ctx);
     sha256_finish_ctx(&ctx, resbuf);
-    base64_encode(resbuf, sizeof(resbuf), txtbuf, sizeof(txtbuf));
+    gpw_base64_encode(resbuf, sizeof(resbuf), txtbuf, sizeof(txtbuf));
     txtbuf[MARK_TEXT_LEN] = NUL;
 
     {
@@ -128,6 +128,16 @@ next_pwid_opt(char const * scan, char const * mark, size_t mark_len)
                 rehash_date = pw_undated;
             break;
 
+        case SET_CMD_KDF:
+            if (STATE_OPT(KDF) == OPTST_DEFINED)
+                continue;
+            break;
+
+        case SET_CMD_ARGON2_COST:
+            if (STATE_OPT(ARGON2_COST) == OPTST_DEFINED)
+                continue;
+            break;
+
         case SET_CMD_SPECIALS:
             if (STATE_OPT(SPECIALS) == OPTST_DEFINED)
                 continue;
@@ -307,6 +317,62 @@ adjust_cclass_val(char const * mark, size_t m_len)
     }
 }
 
+/**
+ * Find the stored rehash count for a password id.
+ *
+ * @param[in]  mark    the password id hash in base64
+ * @param[in]  m_len   the length of that hash
+ *
+ * @returns the stored value, or the default if there is none
+ */
+static uint64_t
+stored_pbkdf2_val(char const * mark, size_t m_len)
+{
+    char * buf =
+        search_for_option(config_file_text, mark, m_len, SET_CMD_USE_PBKDF2);
+    char * scan;
+
+    if (buf == NULL)
+        return (intptr_t)PBKDF2_DFT_ARG;
+
+    scan = strchr(buf, '>');
+    if (scan == NULL)
+        die(GNU_PW_MGR_EXIT_BAD_CONFIG, no_id_mark_end, buf);
+
+    (void) load_one_stored_opt(scan+1);
+    return OPT_VALUE_PBKDF2;
+}
+
+/**
+ * Find the key derivation function for a password id:  the one on the
+ * command line, else the stored one, else the default.
+ *
+ * @param[in]  mark    the password id hash in base64
+ * @param[in]  m_len   the length of that hash
+ *
+ * @returns the KDF_* option value
+ */
+static uintptr_t
+stored_kdf_val(char const * mark, size_t m_len)
+{
+    char * buf;
+    char * scan;
+
+    if (STATE_OPT(KDF) == OPTST_DEFINED)
+        return OPT_VALUE_KDF;
+
+    buf = search_for_option(config_file_text, mark, m_len, SET_CMD_KDF);
+    if (buf == NULL)
+        return OPT_VALUE_KDF;
+
+    scan = strchr(buf, '>');
+    if (scan == NULL)
+        die(GNU_PW_MGR_EXIT_BAD_CONFIG, no_id_mark_end, buf);
+
+    (void) load_one_stored_opt(scan+1);
+    return OPT_VALUE_KDF;
+}
+
 /**
  * Before removing a cclass option from the configuration text,
  * make sure the newly defined option doesn't start with a '+' or '-'.
@@ -318,23 +384,8 @@ adjust_cclass_val(char const * mark, size_t m_len)
 static void
 adjust_pbkdf2_val(char const * mark, size_t m_len)
 {
-    uint64_t     old_pbkdf2 = (intptr_t)PBKDF2_DFT_ARG;
+    uint64_t     old_pbkdf2 = stored_pbkdf2_val(mark, m_len);
     uint64_t     new_pbkdf2 = OPT_VALUE_REHASH;
-    char *       buf =
-        search_for_option(config_file_text, mark, m_len, SET_CMD_USE_PBKDF2);
-
-    /*
-     * If there is an entry, then pull it out and stash the "old" value.
-     */
-    if (buf != NULL) {
-        char * scan = strchr(buf, '>');
-        if (scan == NULL)
-            die(GNU_PW_MGR_EXIT_BAD_CONFIG, no_id_mark_end, buf);
-
-        (void) load_one_stored_opt(scan+1);
-
-        old_pbkdf2 = OPT_VALUE_PBKDF2;
-    }
 
     /*
      * Now adjust the value and see if it has changed.
@@ -428,6 +479,26 @@ remove_defined_opts(char * mark, size_t mark_len)
         res |= remove_opt(mark, mark_len, SET_CMD_USE_PBKDF2);
     }
 
+    /*
+     * A new key derivation function or new Argon2 costs change the
+     * password, so the rehash entry gets re-dated.  Keep its count.
+     */
+    if (  (STATE_OPT(KDF) == OPTST_DEFINED)
+       || (STATE_OPT(ARGON2_COST) == OPTST_DEFINED)) {
+        if (STATE_OPT(KDF) == OPTST_DEFINED)
+            res |= remove_opt(mark, mark_len, SET_CMD_KDF);
+        if (STATE_OPT(ARGON2_COST) == OPTST_DEFINED)
+            res |= remove_opt(mark, mark_len, SET_CMD_ARGON2_COST);
+        if (! HAVE_OPT(REHASH)) {
+            OPT_VALUE_PBKDF2 = stored_pbkdf2_val(mark, mark_len);
+            rehash_date      = pw_today;
+            DESC(PBKDF2).fOptState &= OPTST_PERSISTENT_MASK;
+            DESC(PBKDF2).fOptState |= OPTST_DEFINED;
+            res |= remove_opt(mark, mark_len, SET_CMD_NO_PBKDF2);
+            res |= remove_opt(mark, mark_len, SET_CMD_USE_PBKDF2);
+        }
+    }
+
     if (STATE_OPT(SPECIALS) == OPTST_DEFINED)
         res |= remove_opt(mark, mark_len, SET_CMD_SPECIALS);
 
@@ -438,17 +509,28 @@ remove_defined_opts(char * mark, size_t mark_len)
 }
 
 /**
- * set the options for a particular password id.
+ * set the options for a particular password id and fill in the
+ * derivation context from them.
  * It modifies the \a optCookie field of \a DESC(CCLASS).
  *
  * @param[in]  pw_id   the password id
+ * @param[out] prm     the derivation context for \a pw_id
  */
 static void
-set_pwid_opts(char const * pw_id)
+set_pwid_opts(char const * pw_id, gpw_params_t * prm)
 {
     size_t mark_len;
-    char const * scan = config_file_text;
-    char *       mark = make_pwid_mark(pw_id, &mark_len);
+    char * mark = make_pwid_mark(pw_id, &mark_len);
+
+    /*
+     * Argon2 costs do nothing for the other key derivation functions.
+     * Do not store them, nor re-date the rehash entry for them.
+     */
+    if (  (STATE_OPT(ARGON2_COST) == OPTST_DEFINED)
+       && (stored_kdf_val(mark, mark_len) != KDF_ARGON2ID)) {
+        fprintf(stderr, argon2_unused_fmt, pw_id);
+        DESC(ARGON2_COST).fOptState &= OPTST_PERSISTENT_MASK;
+    }
 
     /*
      * Get rid of any stored options that appear on the command line
@@ -477,16 +559,18 @@ set_pwid_opts(char const * pw_id)
     }
     if (HAVE_OPT(CCLASS))
         sanity_check_cclass();
+
+    set_pw_params(prm, pw_id);
 }
 
 /**
  * Update password specific options.  The password-options must be
  * checked for being "defined" (set on the command line).
  *
- * @param  name  password id
+ * @param  prm  the derivation context of the password id
  */
 static void
-update_pwid_opts(char const * name)
+update_pwid_opts(gpw_params_t const * prm)
 {
     if (strstr(config_file_text, pw_id_tag) == NULL) {
         size_t len = strlen(config_file_text);
@@ -507,7 +591,7 @@ update_pwid_opts(char const * name)
      * We had at least one command line option.
      */
     {
-        char * mark = make_pwid_mark(name, NULL);
+        char * mark = make_pwid_mark(prm->gp_pwid, NULL);
         char const * fnm = access_config_file();
         FILE * fp = fopen(fnm, "w");
 
@@ -545,13 +629,33 @@ update_pwid_opts(char const * name)
          * NOTE CAREFULLY: if there is a previous rehash value, then
          * "have_stored_opts" will be true and we won't update the date.
          */
-        if (HAVE_OPT(REHASH) || (! have_stored_opts)) {
+        if (  HAVE_OPT(REHASH)
+           || (STATE_OPT(KDF) == OPTST_DEFINED)
+           || (STATE_OPT(ARGON2_COST) == OPTST_DEFINED)
+           || (! have_stored_opts)) {
             unsigned int day = (unsigned int)
                 (time(NULL) / SECONDS_IN_DAY);
 	    uint32_t val = HAVE_OPT(REHASH) ? OPT_VALUE_REHASH : OPT_VALUE_PBKDF2;
             fprintf(fp, pwid_pbkdf2_fmt, mark, day, val);
         }
 
+        if (STATE_OPT(KDF) == OPTST_DEFINED)
+            fprintf(fp, pwid_kdf_fmt, mark,
+                    gpw_kdf_name((gpw_kdf_t)OPT_VALUE_KDF));
+
+        /*
+         * Argon2 costs are always recorded with the selection of
+         * Argon2, so a future change of the default cannot change
+         * the password.
+         */
+        if (  (STATE_OPT(ARGON2_COST) == OPTST_DEFINED)
+           || (  (STATE_OPT(KDF) == OPTST_DEFINED)
+              && (OPT_VALUE_KDF == KDF_ARGON2ID)
+              && ! HAVE_OPT(ARGON2_COST))) {
+            fprintf(fp, pwid_argon2_fmt, mark,
+                    prm->gp_passes, prm->gp_mem_kib, prm->gp_lanes);
+        }
+
         if (STATE_OPT(SPECIALS) == OPTST_DEFINED)
             fprintf(fp, pwid_specials_fmt, mark, OPT_ARG(SPECIALS));
 
@@ -563,18 +667,18 @@ update_pwid_opts(char const * name)
 }
 
 /**
- * Remove the password id \a name.
- * @param name  the name/id for which a password is needed
+ * Remove a password id.
+ * @param prm  the derivation context of the password id to remove
  */
 static void
-remove_pwid(char const * name)
+remove_pwid(gpw_params_t const * prm)
 {
     fwrite(rm_entry, rm_entry_LEN, 1, stdout);
-    print_pwid_status(name);
+    print_pwid_status(prm);
     {
         bool         found    = false;
         size_t       mark_len;
-        char *       mark     = make_pwid_mark(name, &mark_len);
+        char *       mark     = make_pwid_mark(prm->gp_pwid, &mark_len);
         char *       scan     = config_file_text;
 
         while (scan = strstr(scan, mark),
@@ -0,0 +1,290 @@
+/**
+ * @file rotate.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * When a new seed is added, every password must eventually be changed.
+ * The rotation report lists, for every domain in the domain name file,
+ * the passwords under the old seeds and under the new one.  The domain
+ * names are used as the password ids.
+ */
+
+/*
+ * The options that can be stored for a password id.  They are reset to
+ * their command line state before the stored options for the next domain
+ * are loaded.
+ */
+static int const rotate_opt_ix[] = {
+    INDEX_OPT_SHARED,   INDEX_OPT_LOGIN_ID, INDEX_OPT_LENGTH,
+    INDEX_OPT_CCLASS,   INDEX_OPT_PBKDF2,   INDEX_OPT_KDF,
+    INDEX_OPT_ARGON2_COST, INDEX_OPT_SPECIALS
+};
+
+#define ROTATE_OPT_CT (sizeof(rotate_opt_ix) / sizeof(rotate_opt_ix[0]))
+
+////PULL-HEADERS:
+
+/**
+ * Put the password id options back the way they were on the command line.
+ * Option arguments allocated while loading stored options are freed.
+ *
+ * @param saved  the option descriptors as they were, ROTATE_OPT_CT entries
+ */
+static void
+rotate_reset_opts(tOptDesc const * saved)
+{
+    size_t ix;
+
+    for (ix = 0; ix < ROTATE_OPT_CT; ix++) {
+        tOptDesc * od = gnu_pw_mgrOptions.pOptDesc + rotate_opt_ix[ix];
+
+        if (  (od->fOptState & OPTST_ALLOC_ARG)
+           && (od->optArg.argString != saved[ix].optArg.argString))
+            free((void *)od->optArg.argString);
+
+        od->fOptState = saved[ix].fOptState;
+        od->optOccCt  = saved[ix].optOccCt;
+        od->optArg    = saved[ix].optArg;
+        od->optCookie = saved[ix].optCookie;
+    }
+
+    rehash_date = pw_undated;
+}
+
+/**
+ * Set the stored options for a domain and fill in its derivation
+ * context.  This is set_pwid_opts() without touching the config file:
+ * command line options override stored ones, but nothing is removed
+ * or updated.
+ *
+ * @param[in]  dom    the domain name
+ * @param[in]  saved  the command line option state
+ * @param[out] prm    the derivation context for \a dom
+ */
+static void
+rotate_set_opts(char const * dom, tOptDesc const * saved, gpw_params_t * prm)
+{
+    size_t mark_len;
+    char * mark;
+
+    rotate_reset_opts(saved);
+    mark = make_pwid_mark(dom, &mark_len);
+    (void) set_stored_opts(mark, mark_len);
+
+    if ((! HAVE_OPT(CCLASS)) && HAVE_OPT(DEFAULT_CCLASS))
+        SET_OPT_CCLASS((uintptr_t) (void*) OPT_ARG(DEFAULT_CCLASS));
+    if (HAVE_OPT(CCLASS))
+        sanity_check_cclass();
+
+    set_pw_params(prm, dom);
+}
+
+/**
+ * Collect the entries of the domain name file.
+ * The names are copied into scribble space.
+ *
+ * @param[out] dom_ct  the number of domains
+ * @returns an allocated array of domains
+ */
+static rotate_dom_t *
+rotate_load_domains(size_t * dom_ct)
+{
+    static char const dom_mark[]     = "<domain time=";
+    static char const end_dom_mark[] = "</domain>";
+
+    rotate_dom_t * doms = NULL;
+    char const *   scan;
+
+    *dom_ct = 0;
+    if (dom_text == NULL)
+        open_dom_file();
+
+    for (scan = dom_text;;) {
+        rotate_dom_t * dom;
+        char const *   name;
+        char const *   end;
+        char *         pn;
+
+        scan = strstr(scan, dom_mark);
+        if (scan == NULL)
+            break;
+        scan += sizeof(dom_mark) - 1;
+        name  = strchr(scan, '>');
+        end   = strstr(scan, end_dom_mark);
+        if ((name == NULL) || (end == NULL) || (end <= name))
+            break;
+        name++;
+
+        if ((*dom_ct % 32) == 0) {
+            size_t sz = (*dom_ct + 32) * sizeof(*doms);
+            doms = realloc(doms, sz);
+            if (doms == NULL)
+                nomem_err(sz, "domain list");
+        }
+
+        dom = doms + (*dom_ct)++;
+        dom->rd_day    = scan;
+        dom->rd_day_no = strtoul(scan, NULL, 10);
+        pn = scribble_get((size_t)(end - name) + 1);
+        memcpy(pn, name, (size_t)(end - name));
+        pn[end - name] = NUL;
+        dom->rd_name   = pn;
+        dom->rd_job    = dom->rd_job_ct = 0;
+
+        scan = end + sizeof(end_dom_mark) - 1;
+    }
+
+    return doms;
+}
+
+/**
+ * qsort comparison:  most recently accessed domains first,
+ * then in name order.
+ */
+static int
+rotate_dom_cmp(void const * l, void const * r)
+{
+    rotate_dom_t const * ld = l;
+    rotate_dom_t const * rd = r;
+
+    if (ld->rd_day_no != rd->rd_day_no)
+        return (ld->rd_day_no > rd->rd_day_no) ? -1 : 1;
+    return strcmp(ld->rd_name, rd->rd_name);
+}
+
+/**
+ * Check that there is a seed named \a new_tag.  It dies if not.
+ *
+ * @param new_tag  the tag of the new seed
+ */
+static void
+rotate_check_tag(char const * new_tag)
+{
+    tOptionValue const * ov = optionFindValue(&DESC(SEED), NULL, NULL);
+
+    while (ov != NULL) {
+        tOptionValue const * tg = optionGetValue(ov, tag_z);
+
+        if (  (tg != NULL) && (tg->valType == OPARG_TYPE_STRING)
+           && (strcmp(tg->v.strVal, new_tag) == 0))
+            return;
+
+        ov = optionFindNextValue(&DESC(SEED), ov, NULL, NULL);
+    }
+
+    die(GNU_PW_MGR_EXIT_NO_SEED, rotate_no_tag_fmt, new_tag);
+}
+
+/**
+ * Print the old and new passwords for every domain in the domain name
+ * file, most recently accessed first.  Each domain gets its own stored
+ * options.  The key derivations for all the domains and seeds are done
+ * in parallel; everything that touches the option state or the scribble
+ * space is done before and after, here.  Nothing is stored.
+ */
+static void
+rotation_report(void)
+{
+    char const * const new_tag = OPT_ARG(ROTATION_REPORT);
+
+    tOptDesc       saved[ROTATE_OPT_CT];
+    rotate_dom_t * doms;
+    size_t         dom_ct;
+    char *         buf;
+    which_job_t *  jobs   = NULL;
+    size_t         job_ct = 0;
+    size_t         ix;
+
+    load_config_file();
+    rotate_check_tag(new_tag);
+
+    doms = rotate_load_domains(&dom_ct);
+    if (dom_ct == 0)
+        die(GNU_PW_MGR_EXIT_INVALID, rotate_no_doms_fmt, dom_file_name);
+
+    for (ix = 0; ix < ROTATE_OPT_CT; ix++)
+        saved[ix] = gnu_pw_mgrOptions.pOptDesc[rotate_opt_ix[ix]];
+
+    for (ix = 0; ix < dom_ct; ix++) {
+        rotate_dom_t *       dom = doms + ix;
+        tOptionValue const * ov  = optionFindValue(&DESC(SEED), NULL, NULL);
+        gpw_params_t         prm;
+
+        rotate_set_opts(dom->rd_name, saved, &prm);
+        prm.gp_specials = NULL; // not needed for the hash
+        dom->rd_job = job_ct;
+
+        do  {
+            if (usable_seed(ov, &prm.gp_tag, &prm.gp_text))
+                jobs = which_add_job(jobs, &job_ct, &prm);
+
+            ov = optionFindNextValue(&DESC(SEED), ov, NULL, NULL);
+        } while (ov != NULL);
+
+        dom->rd_job_ct = job_ct - dom->rd_job;
+    }
+
+    parallel_for(job_ct, which_hash_job, jobs);
+
+    /*
+     * Encoding depends on the length, classes and specials, so the
+     * stored options are loaded again for each domain.  The specials
+     * loaded the first time have been freed.
+     */
+    qsort(doms, dom_ct, sizeof(*doms), rotate_dom_cmp);
+    buf = scribble_get(GPW_PW_BUF_SIZE);
+
+    for (ix = 0; ix < dom_ct; ix++) {
+        rotate_dom_t const * dom = doms + ix;
+        gpw_params_t         prm;
+        size_t               jix;
+
+        rotate_set_opts(dom->rd_name, saved, &prm);
+
+        printf(rotate_hdr_fmt, dom->rd_name, day_to_string(dom->rd_day));
+
+        for (jix = dom->rd_job; jix < dom->rd_job + dom->rd_job_ct; jix++) {
+            which_job_t const * job = jobs + jix;
+            char const * tag    = job->wj_prm.gp_tag;
+            bool const   is_new = (strcmp(tag, new_tag) == 0);
+
+            prm.gp_tag  = tag;
+            prm.gp_text = job->wj_prm.gp_text;
+            check_gpw_rc(job->wj_rc, &prm);
+            check_gpw_rc(gpw_encode(&prm, job->wj_hash, job->wj_hash_len,
+                                    buf, GPW_PW_BUF_SIZE), &prm);
+            printf(rotate_row_fmt, is_new ? rotate_new : rotate_old,
+                   tag, buf);
+        }
+    }
+
+    rotate_reset_opts(saved);
+    free(jobs);
+    free(doms);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of rotate.c */
@@ -16,6 +16,19 @@
  *
  * You should have received a copy of the GNU General Public License along
  * with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ * Scribble space is per thread when the compiler supports thread local
+ * storage (THREAD_LOCAL is set by configure).  Each thread has its own
+ * chain of blocks, so allocating never takes a lock.  Threads other than
+ * the main one must call scribble_deinit() before they exit.
+ *
+ * Allocation bumps an offset in the current block.  When that is full,
+ * the next block is used, or a new one is linked in after the current
+ * one.  Blocks past the current one are always empty.  A scope is
+ * bracketed with scribble_mark() and scribble_release(), which puts the
+ * current block and offset back.  scribble_free() releases everything
+ * and trims the chain down to SCRIBBLE_KEEP_SIZE bytes.
  */
 
 #ifndef _
@@ -28,67 +41,185 @@
 
 #define ROUND_SCRIBBLE(_v, _sz)    (((_v) + ((_sz) - 1)) & ~((_sz) - 1))
 
+/*
+ * The size of blocks kept by scribble_free().
+ */
+#define SCRIBBLE_KEEP_SIZE      0x10000U
+
+/*
+ * Blocks at least this large are mapped and pre-faulted, where the
+ * system allows it, instead of being faulted in a page at a time.
+ */
+#define SCRIBBLE_MAP_SIZE       0x40000U
+
 typedef struct scrib_buf_s scrib_buf_t;
 
 struct scrib_buf_s {
     scrib_buf_t *   sb_next;
     ssize_t  const  sb_size;
     ssize_t         sb_off;
+    bool            sb_mapped;
     unsigned char   sb_buf[1];
 };
 
-static scrib_buf_t *  bufs     = NULL;
-static scrib_buf_t ** next_buf = &bufs;
+/**
+ * The blocks belonging to one thread.
+ */
+typedef struct {
+    scrib_buf_t *   sa_bufs;    ///< first block
+    scrib_buf_t *   sa_cur;     ///< block being filled, NULL if none yet
+} scrib_arena_t;
+
+#ifdef THREAD_LOCAL
+# define SCRIB_TLS THREAD_LOCAL
+#else
+# define SCRIB_TLS
+#endif
+
+static SCRIB_TLS scrib_arena_t scrib_arena = { NULL, NULL };
 static size_t const   hdr_sz   =
     (&(((scrib_buf_t *)NULL)->sb_buf[0])) - ((unsigned char *)NULL);
 
 ////PULL-HEADERS:
 
 /**
- * Initialize scribble space.  This ensures that the library module globals
- * are ready to start.
+ * Initialize scribble space for the calling thread.  This ensures that
+ * its arena is ready to start.
  */
 static void
 scribble_init(void)
 {
-    bufs = NULL;
-    next_buf = &bufs;
+    scrib_arena.sa_bufs = scrib_arena.sa_cur = NULL;
 }
 
 /**
- * De-initialize scribble space.  Frees all the allocated space.
+ * Release the memory of one scribble block.
+ *
+ * @param sb  the block
+ */
+PVT_static void
+scribble_drop_block(scrib_buf_t * sb)
+{
+#if defined(MAP_POPULATE)
+    if (sb->sb_mapped) {
+        munmap(sb, (size_t)sb->sb_size + hdr_sz);
+        return;
+    }
+#endif
+    free(sb);
+}
+
+/**
+ * De-initialize the calling thread's scribble space.
+ * Frees all the space it allocated.
  */
 static void
 scribble_deinit(void)
 {
-    scrib_buf_t * sb = bufs;
+    scrib_buf_t * sb = scrib_arena.sa_bufs;
     scribble_init();
 
     while (sb != NULL) {
         scrib_buf_t * nxt = sb->sb_next;
-        free(sb);
+        scribble_drop_block(sb);
         sb = nxt;
     }
 }
 
 /**
- * Free the space in the scribble buffers.
- * The scribble buffer allocations are *not* freed.
+ * Note the current scribble position of the calling thread.
+ *
+ * @returns the position to hand to scribble_release()
+ */
+static scribble_mark_t
+scribble_mark(void)
+{
+    scribble_mark_t mk = { scrib_arena.sa_cur, 0 };
+
+    if (mk.sm_buf != NULL)
+        mk.sm_off = mk.sm_buf->sb_off;
+    return mk;
+}
+
+/**
+ * Free everything allocated since \a mk was taken.  The blocks are kept.
+ * Marks must be released in the reverse of the order they were taken.
+ *
+ * @param mk  a mark from scribble_mark()
  */
 static void
-scribble_free(void)
+scribble_release(scribble_mark_t mk)
 {
-    scrib_buf_t * sb = bufs;
+    scrib_buf_t * sb = (mk.sm_buf == NULL) ? scrib_arena.sa_bufs : mk.sm_buf;
 
-    while (sb != NULL) {
+    if (sb == NULL)
+        return;
+
+    /*
+     * Blocks past the current one are empty already.
+     */
+    for (;;) {
         sb->sb_off = 0;
+        if (sb == scrib_arena.sa_cur)
+            break;
         sb = sb->sb_next;
     }
+
+    if (mk.sm_buf == NULL)
+        scrib_arena.sa_cur = scrib_arena.sa_bufs;
+    else {
+        mk.sm_buf->sb_off  = mk.sm_off;
+        scrib_arena.sa_cur = mk.sm_buf;
+    }
+}
+
+/**
+ * Free the blocks past the first \a keep bytes worth of them.
+ * Only empty blocks are freed, so this is done after a release.
+ *
+ * @param keep  the number of bytes of blocks to keep
+ */
+static void
+scribble_trim(size_t keep)
+{
+    scrib_buf_t ** link = &(scrib_arena.sa_bufs);
+    size_t         kept = 0;
+
+    for (;;) {
+        scrib_buf_t * sb = *link;
+
+        if (sb == NULL)
+            return;
+
+        if (  (sb->sb_off == 0) && (sb != scrib_arena.sa_cur)
+           && (kept + (size_t)sb->sb_size > keep)) {
+            *link = sb->sb_next;
+            scribble_drop_block(sb);
+            continue;
+        }
+
+        kept += (size_t)sb->sb_size;
+        link  = &(sb->sb_next);
+    }
+}
+
+/**
+ * Free the space in the calling thread's scribble buffers.
+ * Blocks beyond SCRIBBLE_KEEP_SIZE bytes are freed, too.
+ */
+static void
+scribble_free(void)
+{
+    scribble_mark_t const empty = { NULL, 0 };
+
+    scribble_release(empty);
+    scribble_trim(SCRIBBLE_KEEP_SIZE);
 }
 
 /**
  * allocate a new scribble block.  Multiple of 8K bytes, but has at least
- * \a min_size bytes of data space.
+ * \a min_size bytes of data space.  It is linked in after the current
+ * block and becomes the current block.
  *
  * @param min_size  minimum size required for current allocation
  * @returns a pointer to the new buffer
@@ -97,19 +228,40 @@ PVT_static scrib_buf_t *
 new_scribble_block(size_t min_size)
 {
     scrib_buf_t * res = NULL;
+    bool mapped = false;
 
     min_size = ROUND_SCRIBBLE(min_size + hdr_sz, 0x2000U);
 
+#if defined(MAP_POPULATE)
+    if (min_size >= SCRIBBLE_MAP_SIZE) {
+        void * p = mmap(NULL, min_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (p != MAP_FAILED) {
+            res    = p;
+            mapped = true;
+        }
+    }
+#endif
+
+    if (res == NULL) {
+        res = malloc(min_size);
+        if (res == NULL)
+            return NULL;
+    }
+
     /*
-     * Allocate and link into list.  Advance pointer to next entry.
+     * Link in after the current block.
      */
-    *next_buf    = res = malloc(min_size);
-    if (*next_buf == NULL)
-        return NULL;
-
-    next_buf     = &(res->sb_next);
-    res->sb_next = NULL;
-    res->sb_off  = 0;
+    if (scrib_arena.sa_cur == NULL) {
+        res->sb_next        = scrib_arena.sa_bufs;
+        scrib_arena.sa_bufs = res;
+    } else {
+        res->sb_next = scrib_arena.sa_cur->sb_next;
+        scrib_arena.sa_cur->sb_next = res;
+    }
+    scrib_arena.sa_cur = res;
+    res->sb_off    = 0;
+    res->sb_mapped = mapped;
     /*
      *  The "sb_size" field is read-only.  Override this during allocation.
      */
@@ -122,7 +274,8 @@ new_scribble_block(size_t min_size)
 }
 
 /**
- * Get some scribble space.  Allocates a new scribble buffer, if needed.
+ * Get some scribble space for the calling thread.
+ * Allocates a new scribble buffer, if needed.
  * The allocation gets incremented by one and then rounded to a multiple
  * of sizeof(void *).
  *
@@ -132,24 +285,25 @@ new_scribble_block(size_t min_size)
 static void *
 scribble_get(ssize_t size)
 {
-    scrib_buf_t * sb = bufs;
+    scrib_buf_t * sb = scrib_arena.sa_cur;
     char * buf;
 
      // allow for NUL byte & round to word boundary
     size  = ROUND_SCRIBBLE(size+1, (ssize_t)sizeof(void *));
 
-    for (;;) {
-        if (sb == NULL) {
+    if ((sb == NULL) || ((sb->sb_size - sb->sb_off) < size)) {
+        /*
+         * The next block is empty.  Use it if it is big enough.
+         */
+        sb = (sb == NULL) ? scrib_arena.sa_bufs : sb->sb_next;
+        if ((sb != NULL) && (sb->sb_size >= size))
+            scrib_arena.sa_cur = sb;
+
+        else {
             sb = new_scribble_block((size_t)size);
             if (sb == NULL)
                 return NULL;
-            break;
         }
-
-        if ((sb->sb_size - sb->sb_off) >= size)
-            break;
-
-        sb   = sb->sb_next;
     }
 
     buf = (char *)(sb->sb_buf + sb->sb_off);
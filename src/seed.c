@@ -25,29 +25,21 @@
 ////PULL-HEADERS:
 
 /**
- * set a new random seed for seed text padding.  This is done every
- * 16 bytes of padding.  Otherwise, a fully padded 64 byte seed text
- * would only have 32,000 variations.  Reading the random device
- * 64 times uses up too much of the entropy for a smallish gain.
+ * Seed text cannot hold the "</text>" end mark.  Random text might,
+ * so alter any that turn up.  There's one chance in 95 ^ 7 or roughly
+ * 1 in 100,000,000,000,000 for each place it could start.
  *
- * @param[in] wiggle  if there is no random device, then wiggle the
- * time a little bit.  time() will likely return the same second
- * every time, so alter this unpredictable seed a little bit to
- * make its predictability a bit more difficult.
+ * @param[in,out] txt  the seed text
  */
 static void
-randomize_seed(int wiggle)
+clear_text_mark(char * txt)
 {
-    int fd = open(NAME_OF_RANDOM_DEVICE, O_RDONLY);
-    unsigned int srand_seed = 0;
-    if (fd < 0) {
-        srand_seed = (int) time(NULL) + wiggle;
-    } else {
-        if (read(fd, &srand_seed, sizeof(srand_seed)) != sizeof(srand_seed))
-            srand_seed = (int) time(NULL) + wiggle;
-        close(fd);
+    for (;;) {
+        txt = strstr(txt, end_text_mark);
+        if (txt == NULL)
+            break;
+        txt[1] = '=';
     }
-    srand(srand_seed);
 }
 
 /**
@@ -64,50 +56,58 @@ get_seed_text(void)
     if (text_len >= MIN_SEED_TEXT_LEN)
         return res;
 
-    randomize_seed(0);
-
     {
-        char * new_txt = malloc(128);
-        if (new_txt == NULL)
+        char * buf     = malloc(128);
+        char * new_txt = buf;
+        if (buf == NULL)
             nomem_err(128, "seed");
-        if (text_len == 0) {
-            res = new_txt;
-        } else {
+        if (text_len > 0) {
             memcpy(new_txt, res, text_len);
-            res = new_txt;
             new_txt += text_len;
         }
+        res = buf;
         text_len = MIN_SEED_TEXT_LEN - text_len;
         fprintf(stderr, adding_text, (unsigned int)text_len);
-        for (;;) {
-            unsigned char ch = (rand() % 95) + ' ';
-            *(new_txt++) = ch;
-            if ((--text_len & 0xF) == 0) {
-                if (text_len == 0)
-                    break;
-                randomize_seed((int)text_len);
-            }
-        }
-        *new_txt = NUL;
-
-        /*
-         *  The following code checks for randomly matching
-         *  "</text>".  There's one chance in 95 ^ 7 or roughly
-         *  1 in 100,000,000,000,000
-         *  50% chance of seeing it after a billion tries.
-         *  (You get about 60 tries in a 64 byte string.)
-         */
-        for (;;) {
-            new_txt = strstr(res, end_text_mark);
-            if (new_txt == NULL)
-                break;
-            new_txt[1] = '=';
-        }
+        entropy_printable(new_txt, text_len);
+        new_txt[text_len] = NUL;
+        clear_text_mark(buf);
     }
 
     return res;
 }
 
+/**
+ * Print \a OPT_VALUE_GENERATE_SEEDS random seed texts, one per line.
+ * They are drawn from the 89 printable characters that are safe between
+ * shell quotes, so they are GEN_SEED_TEXT_LEN long:  65 of those hold
+ * a little more randomness than MIN_SEED_TEXT_LEN of all 95 printable
+ * characters.  The random bytes for all of them are drawn at once.
+ */
+static void
+generate_seeds(void)
+{
+    size_t ct  = (size_t)OPT_VALUE_GENERATE_SEEDS;
+    char * txt = malloc(ct * GEN_SEED_TEXT_LEN);
+    char * scan;
+
+    if (txt == NULL)
+        nomem_err(ct * GEN_SEED_TEXT_LEN, "seeds");
+    entropy_shell_safe(txt, ct * GEN_SEED_TEXT_LEN);
+
+    for (scan = txt; ct-- > 0; scan += GEN_SEED_TEXT_LEN) {
+        char seed[GEN_SEED_TEXT_LEN + 1];
+
+        memcpy(seed, scan, GEN_SEED_TEXT_LEN);
+        seed[GEN_SEED_TEXT_LEN] = NUL;
+        clear_text_mark(seed);
+        puts(seed);
+        memset(seed, 0, sizeof(seed));
+    }
+
+    memset(txt, 0, (size_t)OPT_VALUE_GENERATE_SEEDS * GEN_SEED_TEXT_LEN);
+    free(txt);
+}
+
 /**
  * convert version to a number.  Limits version numbers to 4095.4095.4095
  * and ignores anything beyond the third component.
@@ -21,115 +21,383 @@ static char * find_cfg_name(void);
 #define set_config_name(_f)
 #include "cfg-file.c"
 #undef xscribble_get
+#include "scribble.c"
+#include "parallel.c"
 
-typedef struct pw_opt_line pw_opt_line_t;
+#define OPT_SET_MIN     1024            ///< first line and hash table size
+#define OPT_LINE_GUESS  48              ///< bytes per line, for presizing
 
-struct pw_opt_line {
-    pw_opt_line_t * next;
-    pw_opt_line_t * prev;
-    char const *    line;
-};
+/*
+ * One per_pw_id line.  Its key is the password id mark and the option
+ * name:  the text from after ' id="' up to the first '=', or up to the
+ * first '>' for a line without an '='.
+ */
+typedef struct {
+    char const *    ol_line;        ///< the line, NUL terminated
+    char const *    ol_key;         ///< its key
+    size_t          ol_key_len;     ///< key length
+    size_t          ol_hash;        ///< hash of the key
+} pw_opt_line_t;
 
-static pw_opt_line_t opt_hash[0x4000];
+/*
+ * The per_pw_id lines of the config files.  A line replaces an earlier
+ * one with the same key.  The hash table holds line numbers plus one,
+ * so that zero is an empty slot.  Both arrays double as they fill.
+ */
+typedef struct {
+    pw_opt_line_t * os_lines;
+    size_t          os_ct;
+    size_t          os_max;
+    size_t *        os_hash;
+    size_t          os_hash_mask;
+} pw_opt_set_t;
 
 /*
- * This is a 16K entry hash table.  Collisions are unlikely, unless you
- * really have an awful lot of passwords you are maintaining.
+ * A config file to be merged:  the text after its per_pw_id tag,
+ * and then its lines.
  */
-#define TXT_HASH(_s) ( \
-    ((unsigned int)((_s)[0]) << 7) \
-    + (unsigned int)((_s)[1])  )
+typedef struct {
+    char *          ci_text;
+    size_t          ci_len;
+    pw_opt_set_t    ci_set;
+} cfg_input_t;
 
+static pw_opt_set_t  opt_set      = { NULL, 0, 0, NULL, 0 };
+static cfg_input_t * cfg_inputs   = NULL;
+static size_t        cfg_input_ct = 0;
+
+/**
+ * Hash a line key (64 bit FNV-1a).
+ */
+static inline size_t
+opt_key_hash(char const * key, size_t len)
+{
+    uint64_t res = 14695981039346656037ULL;
+
+    while (len-- > 0) {
+        res ^= (unsigned char)*(key++);
+        res *= 1099511628211ULL;
+    }
+
+    return (size_t)res;
+}
+
+/**
+ * Find the hash table slot for a key.
+ *
+ * @returns the slot holding the number of the line with the key,
+ * or else the empty slot where it belongs.
+ */
+static size_t *
+opt_set_slot(pw_opt_set_t * set, char const * key, size_t len, size_t hash)
+{
+    size_t ix = hash & set->os_hash_mask;
+
+    for (;;) {
+        size_t *              slot = set->os_hash + ix;
+        pw_opt_line_t const * ol;
+
+        if (*slot == 0)
+            return slot;
+
+        ol = set->os_lines + *slot - 1;
+        if (  (ol->ol_hash == hash) && (ol->ol_key_len == len)
+           && (memcmp(ol->ol_key, key, len) == 0))
+            return slot;
+
+        ix = (ix + 1) & set->os_hash_mask;
+    }
+}
+
+/**
+ * Double the hash table (or make the first one) and enter every line.
+ * The new table has room for at least \a min_ct lines.
+ *
+ * @param set     the line set
+ * @param min_ct  the line count to make room for
+ */
+static void
+opt_set_grow_hash(pw_opt_set_t * set, size_t min_ct)
+{
+    size_t ct = (set->os_hash == NULL)
+        ? OPT_SET_MIN : (set->os_hash_mask + 1) * 2;
+    size_t ix;
+
+    while (ct < min_ct * 2)
+        ct *= 2;
+
+    free(set->os_hash);
+    set->os_hash = calloc(ct, sizeof(*set->os_hash));
+    if (set->os_hash == NULL)
+        nomem_err(ct * sizeof(*set->os_hash), "line hash");
+    set->os_hash_mask = ct - 1;
+
+    for (ix = 0; ix < set->os_ct; ix++) {
+        pw_opt_line_t const * ol = set->os_lines + ix;
+        *opt_set_slot(set, ol->ol_key, ol->ol_key_len, ol->ol_hash) = ix + 1;
+    }
+}
+
+/**
+ * Make room in a set for \a ct lines.
+ *
+ * @param set  the line set
+ * @param ct   the line count
+ */
+static void
+opt_set_reserve(pw_opt_set_t * set, size_t ct)
+{
+    if (ct * 2 > set->os_hash_mask + 1)
+        opt_set_grow_hash(set, ct);
+
+    if (ct > set->os_max) {
+        size_t sz = ct * sizeof(*set->os_lines);
+
+        set->os_lines = realloc(set->os_lines, sz);
+        if (set->os_lines == NULL)
+            nomem_err(sz, "config lines");
+        set->os_max = ct;
+    }
+}
+
+/**
+ * Add a line to a set, or replace the line with the same key.
+ *
+ * @param set  the line set
+ * @param txt  the line
+ * @param key  its key
+ * @param len  the key length
+ */
 static inline void
-add_hash_entry(pw_opt_line_t * ol, char const * txt)
+add_hash_entry(pw_opt_set_t * set, char const * txt,
+               char const * key, size_t len)
 {
-    static char const id_str[] = " id=\"";
-    char const * hash_txt = strstr(txt, id_str);
-    unsigned int hash_len;
-    unsigned int off;
+    size_t          hash = opt_key_hash(key, len);
+    size_t *        slot;
+    pw_opt_line_t * ol;
 
-    if (hash_txt == NULL)
+    if (set->os_ct >= set->os_max)
+        opt_set_reserve(set, (set->os_max < OPT_SET_MIN)
+                        ? OPT_SET_MIN : (set->os_max * 2));
+
+    slot = opt_set_slot(set, key, len, hash);
+    if (*slot != 0) {
+        set->os_lines[*slot - 1].ol_line = txt;
         return;
+    }
 
-    hash_txt += sizeof(id_str) - 1;
-    off = hash_txt - txt;
+    ol = set->os_lines + set->os_ct;
+    ol->ol_line    = txt;
+    ol->ol_key     = key;
+    ol->ol_key_len = len;
+    ol->ol_hash    = hash;
+    *slot = ++(set->os_ct);
+}
 
-    {
-        char const * equ = strchr(hash_txt, '=');
-        if (equ == NULL)
-            return;
-        hash_len = equ - hash_txt;
-    }
+/**
+ * Compare the keys of two lines:  byte by byte, then by length.
+ */
+static inline int
+opt_line_cmp(pw_opt_line_t const * l, pw_opt_line_t const * r)
+{
+    size_t len = (l->ol_key_len < r->ol_key_len) ? l->ol_key_len : r->ol_key_len;
+    int    res = memcmp(l->ol_key, r->ol_key, len);
+
+    if (res != 0)
+        return res;
+    if (l->ol_key_len == r->ol_key_len)
+        return 0;
+    return (l->ol_key_len < r->ol_key_len) ? -1 : 1;
+}
 
-    {
-        int hash_ix = TXT_HASH(hash_txt);
-        pw_opt_line_t * olh = opt_hash + hash_ix;
-        pw_opt_line_t * ole = olh->next;
-        while (ole != olh) {
-            if (strncmp(ole->line + off, hash_txt, hash_len) == 0) {
-                ole->line = txt;
-                return;
-            }
-            ole = ole->next;
+/**
+ * Sort the lines of a set by key, with a bottom up merge sort.
+ * The hash table is no longer valid afterwards, and is released.
+ *
+ * @param set  the line set
+ */
+static void
+opt_set_sort(pw_opt_set_t * set)
+{
+    size_t          ct  = set->os_ct;
+    pw_opt_line_t * src = set->os_lines;
+    pw_opt_line_t * dst;
+    pw_opt_line_t * tmp;
+    size_t          run;
+
+    free(set->os_hash);
+    set->os_hash      = NULL;
+    set->os_hash_mask = 0;
+    if (ct < 2)
+        return;
+
+    tmp = dst = malloc(ct * sizeof(*dst));
+    if (dst == NULL)
+        nomem_err(ct * sizeof(*dst), "config line sort");
+
+    for (run = 1; run < ct; run *= 2) {
+        size_t lo;
+
+        for (lo = 0; lo < ct; lo += 2 * run) {
+            size_t md = (lo + run < ct) ? (lo + run) : ct;
+            size_t hi = (md + run < ct) ? (md + run) : ct;
+            size_t li = lo, ri = md, ox = lo;
+
+            while ((li < md) && (ri < hi))
+                dst[ox++] = (opt_line_cmp(src + ri, src + li) < 0)
+                    ? src[ri++] : src[li++];
+            while (li < md)
+                dst[ox++] = src[li++];
+            while (ri < hi)
+                dst[ox++] = src[ri++];
         }
 
-        ole = olh->next;
-        ol->line  = txt;
+        tmp = src; src = dst; dst = tmp;
+    }
+
+    /*
+     * "src" holds the sorted lines.  Free the other buffer.
+     */
+    if (src != set->os_lines) {
+        free(set->os_lines);
+        set->os_lines = src;
+        set->os_max   = ct;
+    } else
+        free(dst);
+}
+
+/**
+ * parse each line of text in one pass.  memchr() finds the line ends
+ * and the '=' ending each key.  Lines that do not start with a pwtag
+ * (after any blanks) are skipped.  The set is sized for the text first,
+ * so it seldom has to grow.
+ *
+ * @param set   the line set to add the lines to
+ * @param text  the text after the per_pw_id tag
+ * @param len   its length
+ */
+static inline void
+parse_cfg_text(pw_opt_set_t * set, char * text, size_t len)
+{
+    char * const end = text + len;
+
+    opt_set_reserve(set, len / OPT_LINE_GUESS + 1);
+
+    while (text < end) {
+        char *       eol = memchr(text, NL, (size_t)(end - text));
+        char const * key;
+        char const * equ;
+
+        if (eol == NULL)
+            eol = end;
+        *eol = NUL;
+
+        key = text;
+        while ((*key == ' ') || (*key == '\t'))
+            key++;
 
         /*
-         * Keep the list sorted.  We could have used a singly linked list...
+         * The key starts after the quote following "<pwtag id=".
+         * A line with no '=', like the "shared" mark, has a key
+         * that ends at the '>' closing the tag.
          */
-        while (ole != olh) {
-            if (strncmp(ole->line + off, hash_txt, hash_len) > 0)
-                break;
-            ole = ole->next;
+        if (  (eol - key > pwtag_z_LEN)
+           && (memcmp(key, pwtag_z, pwtag_z_LEN) == 0)
+           && (key[pwtag_z_LEN] == '"')) {
+            key += pwtag_z_LEN + 1;
+            equ  = memchr(key, '=', (size_t)(eol - key));
+            if (equ == NULL) {
+                equ = memchr(key, '>', (size_t)(eol - key));
+                if (equ == NULL)
+                    equ = eol;
+            }
+            add_hash_entry(set, text, key, (size_t)(equ - key));
         }
 
-        /*
-         * Insert before the "ole" entry.
-         */
-        ol->next  = ole;
-        ol->prev  = ole->prev;
-        ole->prev->next = ol;
-        ole->prev = ol;
+        text = eol + 1;
     }
 }
 
 /**
- * parse each line of text
- * @param text  the start of the current line of text
+ * parallel_for() job:  parse one config file into its own line set
+ * and sort it.
+ *
+ * @param ctx  the config file list
+ * @param ix   the index of the one to parse
  */
-static inline void
-parse_cfg_text(char * text)
+static void
+parse_cfg_job(void * ctx, size_t ix)
 {
-    int ct = 0;
-    {
-        char * scan = strchr(text, NL);
-        while (scan != NULL) {
-            ct++;
-            scan = strchr(scan + 1, NL);
-        }
+    cfg_input_t * ci = (cfg_input_t *)ctx + ix;
+
+    parse_cfg_text(&ci->ci_set, ci->ci_text, ci->ci_len);
+    opt_set_sort(&ci->ci_set);
+}
+
+/**
+ * Merge the sorted lines of the config files into "opt_set".  Where
+ * several files have a line with the same key, the line from the last
+ * of them is kept, just as if the files were read one after another.
+ */
+static void
+merge_cfg_inputs(void)
+{
+    size_t * pos;
+    size_t   total = 0;
+    size_t   ix;
+
+    if (cfg_input_ct == 1) {
+        opt_set = cfg_inputs[0].ci_set;
+        return;
     }
-    {
-        pw_opt_line_t * opt_list = malloc(ct * sizeof(*opt_list));
-        ct = 0;
-        for (;;) {
-            add_hash_entry(opt_list + (ct++), text);
-            text = strchr(text, NL);
-            if (text == NULL)
-                break;
-            *(text++) = NUL;
-            text = strstr(text, pwtag_z);
-            if (text == NULL)
-                break;
+
+    for (ix = 0; ix < cfg_input_ct; ix++)
+        total += cfg_inputs[ix].ci_set.os_ct;
+
+    pos = calloc(cfg_input_ct + 1, sizeof(*pos));
+    opt_set.os_lines = malloc((total + 1) * sizeof(*opt_set.os_lines));
+    if ((pos == NULL) || (opt_set.os_lines == NULL))
+        nomem_err((total + 1) * sizeof(*opt_set.os_lines), "config merge");
+    opt_set.os_max = total;
+
+    for (;;) {
+        pw_opt_line_t const * best = NULL;
+
+        /*
+         * Find the least key.  With "<=", the last file having it wins.
+         */
+        for (ix = 0; ix < cfg_input_ct; ix++) {
+            pw_opt_set_t const * set = &cfg_inputs[ix].ci_set;
+
+            if (  (pos[ix] < set->os_ct)
+               && ((best == NULL)
+                  || (opt_line_cmp(set->os_lines + pos[ix], best) <= 0)))
+                best = set->os_lines + pos[ix];
+        }
+
+        if (best == NULL)
+            break;
+        opt_set.os_lines[opt_set.os_ct++] = *best;
+
+        for (ix = 0; ix < cfg_input_ct; ix++) {
+            pw_opt_set_t const * set = &cfg_inputs[ix].ci_set;
+
+            if (  (pos[ix] < set->os_ct)
+               && (opt_line_cmp(set->os_lines + pos[ix],
+                                opt_set.os_lines + opt_set.os_ct - 1) == 0))
+                pos[ix]++;
         }
     }
+
+    for (ix = 0; ix < cfg_input_ct; ix++)
+        free(cfg_inputs[ix].ci_set.os_lines);
+    free(pos);
 }
 
 /**
- * initialize the hash table and set the "config file name"
- * to that of the first config file (used for default output),
- * and remember the header block from that file.
+ * set the "config file name" to that of the first config file
+ * (used for default output), and remember the header block from
+ * that file.
  *
  * @param fname  name of the first config file
  * @param text   the header block from that file.
@@ -137,19 +405,14 @@ parse_cfg_text(char * text)
 static inline void
 init_config_data(char const * fname, char * text)
 {
-    int ct = sizeof(opt_hash) / sizeof(opt_hash[0]);
-    pw_opt_line_t * olh = opt_hash;
-
     config_file_name = fname;
     leader_text = text;
-    do  {
-        olh->next = olh->prev = olh;
-        olh++;
-    } while (--ct > 0);
 }
 
 /**
  * Load the domain-specific attributes from a config file.
+ * The header is split off here.  The lines are parsed later, for all
+ * the files at once.
  *
  * @param fname    name of the config file
  * @param text     the text in that file
@@ -158,6 +421,8 @@ init_config_data(char const * fname, char * text)
 int
 load_domain_attrs(char const * fname, char * text, size_t text_sz)
 {
+    char * const text_end = text + text_sz;
+
     if (config_file_name == NULL)
         init_config_data(fname, text);
 
@@ -170,7 +435,20 @@ load_domain_attrs(char const * fname, char * text, size_t text_sz)
     while (isspace(*text))
         text++;
 
-    parse_cfg_text(text);
+    if ((cfg_input_ct & (cfg_input_ct - 1)) == 0) {
+        size_t sz = (cfg_input_ct == 0 ? 1 : (cfg_input_ct * 2))
+            * sizeof(*cfg_inputs);
+
+        cfg_inputs = realloc(cfg_inputs, sz);
+        if (cfg_inputs == NULL)
+            nomem_err(sz, "config file list");
+    }
+
+    cfg_inputs[cfg_input_ct].ci_text = text;
+    cfg_inputs[cfg_input_ct].ci_len  =
+        (text < text_end) ? (size_t)(text_end - text) : 0;
+    cfg_inputs[cfg_input_ct].ci_set  = (pw_opt_set_t) { NULL, 0, 0, NULL, 0 };
+    cfg_input_ct++;
 
     return SORT_PW_CFG_EXIT_SUCCESS;
 }
@@ -215,6 +493,15 @@ sort_pw_cfg_exit_code_t
 emit_new_text(void)
 {
     FILE * fp;
+    size_t ix;
+
+    /*
+     * Parse and merge before anything is opened for writing:  the output
+     * may be one of the inputs, and opening it truncates it.  A failure
+     * here must also leave it as it was.
+     */
+    parallel_for(cfg_input_ct, parse_cfg_job, cfg_inputs);
+    merge_cfg_inputs();
 
     if (! HAVE_OPT(OUTPUT)) {
         fp = open_cfg_for_output();
@@ -236,19 +523,9 @@ emit_new_text(void)
     fputs(leader_text, fp);
     fputc(NL, fp);
 
-    {
-        pw_opt_line_t * olh = opt_hash;
-        int ix = sizeof(opt_hash) / sizeof(opt_hash[0]);
-
-        do  {
-            pw_opt_line_t * ole = olh->next;
-            while (ole != olh) {
-                fputs(ole->line, fp);
-                fputc(NL, fp);
-                ole = ole->next;
-            }
-            olh++;
-        } while (--ix > 0);
+    for (ix = 0; ix < opt_set.os_ct; ix++) {
+        fputs(opt_set.os_lines[ix].ol_line, fp);
+        fputc(NL, fp);
     }
 
     fchmod(fileno(fp), S_IRUSR);
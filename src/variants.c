@@ -0,0 +1,254 @@
+/**
+ * @file variants.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The derived hash does not depend on the password length or character
+ * classes.  Those only affect how the hash is encoded.  So candidates
+ * for many lengths and classes can be produced from one derivation.
+ */
+
+/*
+ * The character class sets tried for every length, after the current
+ * setting for the password id.  PIN numbers are tried, too.
+ */
+static uintptr_t const variant_cclass[] = {
+    CCLASS_ALPHA | CCLASS_DIGIT,
+    CCLASS_ALPHA | CCLASS_DIGIT | CCLASS_NO_SPECIAL,
+    CCLASS_ALPHA | CCLASS_DIGIT | CCLASS_SPECIAL,
+    CCLASS_UPPER | CCLASS_LOWER | CCLASS_DIGIT,
+    CCLASS_UPPER | CCLASS_LOWER | CCLASS_DIGIT | CCLASS_SPECIAL,
+    CCLASS_NO_ALPHA | CCLASS_NO_SPECIAL
+};
+
+#define VARIANT_CCLASS_CT (sizeof(variant_cclass) / sizeof(variant_cclass[0]))
+#define VARIANT_MAX_CT    (1 + VARIANT_CCLASS_CT)
+#define PW_LEN_MIN        GPW_MIN_LENGTH
+#define PW_LEN_MAX        GPW_MAX_LENGTH
+
+////PULL-HEADERS:
+
+/**
+ * Parse a list of password lengths.  Lengths are separated by commas
+ * or spaces and may be ranges ("8-12").  The result is sorted and
+ * duplicates are removed.
+ *
+ * @param[in]  list  the length list text
+ * @param[out] lens  the length array, at least PW_LEN_MAX+1 entries
+ * @returns the number of lengths
+ */
+static size_t
+parse_variant_lengths(char const * list, unsigned int * lens)
+{
+    bool          want[PW_LEN_MAX + 1] = { false };
+    size_t        ct = 0;
+    unsigned long lo, hi;
+    char const *  p  = list + strspn(list, " ,");
+
+    while (*p != NUL) {
+        char * pn;
+
+        errno = 0;
+        lo = hi = strtoul(p, &pn, 10);
+        if ((errno == 0) && (pn > p) && (*pn == '-')) {
+            p  = pn + 1;
+            hi = strtoul(p, &pn, 10);
+        }
+
+        if (  (errno != 0) || (pn == p) || (lo < PW_LEN_MIN) || (hi < lo)
+           || (hi > PW_LEN_MAX))
+            usage_message(bad_variant_len, list);
+
+        while (lo <= hi)
+            want[lo++] = true;
+        p = pn + strspn(pn, " ,");
+    }
+
+    for (lo = PW_LEN_MIN; lo <= PW_LEN_MAX; lo++)
+        if (want[lo])
+            lens[ct++] = (unsigned int)lo;
+
+    if (ct == 0)
+        usage_message(bad_variant_len, list);
+    return ct;
+}
+
+/**
+ * Make the list of character class sets to show.  The current value for
+ * the password id comes first.  The fixed sets follow, without duplicates.
+ *
+ * @param[out] sets  the class bit sets, VARIANT_MAX_CT entries
+ * @returns the number of sets
+ */
+static size_t
+variant_cclass_sets(uintptr_t * sets)
+{
+    size_t ct = 0;
+    size_t ix;
+
+    sets[ct++] = OPT_VALUE_CCLASS;
+    for (ix = 0; ix < VARIANT_CCLASS_CT; ix++)
+        if (variant_cclass[ix] != OPT_VALUE_CCLASS)
+            sets[ct++] = variant_cclass[ix];
+
+    return ct;
+}
+
+/**
+ * Encode one derived hash for a list of lengths and class sets.
+ * The password lengths must all fall on the same side of the
+ * rehash limit (GPW_KDF_MAX_LENGTH), so that they share the hash.
+ *
+ * @param hash      the derived hash
+ * @param hash_len  its length
+ * @param lens      the password lengths
+ * @param len_ct    the length count
+ * @param sets      the character class sets
+ * @param set_ct    the set count
+ * @param names     the display names of the sets
+ * @param prm       the parameters the hash was derived with
+ */
+static void
+print_variant_rows(unsigned char const * hash, size_t hash_len,
+                   unsigned int const * lens, size_t len_ct,
+                   uintptr_t const * sets, size_t set_ct,
+                   char const * const * names, gpw_params_t const * prm)
+{
+    gpw_params_t vprm = *prm;
+    char *       buf  = scribble_get(GPW_PW_BUF_SIZE);
+    size_t       lix, six;
+
+    for (lix = 0; lix < len_ct; lix++) {
+        vprm.gp_length = lens[lix];
+
+        for (six = 0; six < set_ct; six++) {
+            gpw_err_t rc;
+
+            /*
+             * Passwords shorter than MIN_PW_LEN are only PIN numbers
+             * and PIN numbers are limited by the hash size.
+             */
+            vprm.gp_cclass = (uint32_t)sets[six];
+            rc = gpw_encode(&vprm, hash, hash_len, buf, GPW_PW_BUF_SIZE);
+            if ((rc == GPW_ERR_LENGTH) || (rc == GPW_ERR_PIN_LENGTH))
+                continue;
+
+            check_gpw_rc(rc, &vprm);
+            printf(variant_row_fmt, lens[lix], names[six], buf);
+        }
+    }
+}
+
+/**
+ * Print a table of candidate passwords for a password id: every seed,
+ * for every requested length and a list of character class sets.
+ * The key derivation is done only once per seed (twice, if some lengths
+ * are beyond the rehash limit).  Nothing is stored.
+ *
+ * @param pwid_prm  the derivation context of the password id
+ */
+static void
+print_variants(gpw_params_t const * pwid_prm)
+{
+    static char const dft_lengths[] = "8,12,16,20,24,32";
+
+    unsigned int lens[PW_LEN_MAX + 1];
+    uintptr_t    sets[VARIANT_MAX_CT];
+    char const * names[VARIANT_MAX_CT];
+    size_t       len_ct, short_ct, set_ct, ix;
+    bool         printed_pw = false;
+
+    uintptr_t const save_cclass = OPT_VALUE_CCLASS;
+
+    tOptionValue const * ov = optionFindValue(&DESC(SEED), NULL, NULL);
+
+    len_ct = parse_variant_lengths(
+        (OPT_ARG(VARIANTS) != NULL) ? OPT_ARG(VARIANTS) : dft_lengths, lens);
+    set_ct = variant_cclass_sets(sets);
+
+    /*
+     * Lengths up to the limit use the selected key derivation.
+     * Longer ones use the plain hash.  Sorted, so find the split.
+     */
+    for (short_ct = 0; short_ct < len_ct; short_ct++)
+        if (lens[short_ct] > GPW_KDF_MAX_LENGTH)
+            break;
+
+    {
+        tOptDesc *   od   = &DESC(CCLASS);
+        char const * save = od->optArg.argString;
+
+        for (ix = 0; ix < set_ct; ix++) {
+            od->optCookie = (void *)sets[ix];
+            doOptCclass(OPTPROC_RETURN_VALNAME, od);
+            names[ix] = od->optArg.argString;
+        }
+        od->optArg.argString = save;
+    }
+
+    if (HAVE_OPT(LOGIN_ID))
+        printf(hdr_hint, OPT_ARG(LOGIN_ID));
+
+    do  {
+        gpw_params_t  prm = *pwid_prm;
+        unsigned char hash[GPW_HASH_MAX];
+
+        if (usable_seed(ov, &prm.gp_tag, &prm.gp_text)) {
+            printed_pw = true;
+            printf(variant_hdr_fmt, prm.gp_tag, rehash_date);
+
+            if (short_ct > 0) {
+                prm.gp_length = lens[short_ct - 1];
+                check_gpw_rc(gpw_derive_hash(&prm, hash, sizeof(hash)), &prm);
+                print_variant_rows(hash, gpw_hash_len(&prm), lens, short_ct,
+                                   sets, set_ct, names, &prm);
+            }
+
+            if (short_ct < len_ct) {
+                prm.gp_length = lens[len_ct - 1];
+                check_gpw_rc(gpw_derive_hash(&prm, hash, sizeof(hash)), &prm);
+                print_variant_rows(hash, gpw_hash_len(&prm), lens + short_ct,
+                                   len_ct - short_ct,
+                                   sets, set_ct, names, &prm);
+            }
+            memset(hash, 0, sizeof(hash));
+        }
+
+        ov = optionFindNextValue(&DESC(SEED), ov, NULL, NULL);
+    } while (ov != NULL);
+
+    for (ix = 0; ix < set_ct; ix++)
+        free((void *)names[ix]);
+
+    DESC(CCLASS).optCookie = (void *)save_cclass;
+
+    if (! printed_pw)
+        die(GNU_PW_MGR_EXIT_NO_SEED, no_passwords,
+            ENABLED_OPT(SHARED) ? sec_pw_type : "");
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of variants.c */
@@ -0,0 +1,354 @@
+/**
+ * @file which.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Search for the settings that yield a known password.  The expensive
+ * part, the key derivation, is done once for each seed, backend and
+ * rehash count, in parallel.  The cheap part, encoding the hash with
+ * each character class set, is done afterwards, one hash at a time.
+ */
+
+#define WHICH_MAX_REHASH  64
+
+////PULL-HEADERS:
+
+/**
+ * Collect the distinct rehash counts: the current one for the password
+ * id, the default, then every count stored in the config file.  A count
+ * of zero disables rehashing, so it is never listed.
+ *
+ * @param[out] cts  the rehash counts, WHICH_MAX_REHASH entries
+ * @returns the number of counts
+ */
+static size_t
+which_rehash_counts(unsigned long * cts)
+{
+    static char const use_mark[] = ">use-pbkdf2 = ";
+    char const * scan = config_file_text;
+    size_t       ct   = 0;
+
+    if (OPT_VALUE_PBKDF2 > 0)
+        cts[ct++] = (unsigned long)OPT_VALUE_PBKDF2;
+    if ((ct == 0) || (GPW_DFT_REHASH != cts[0]))
+        cts[ct++] = GPW_DFT_REHASH;
+
+    while (ct < WHICH_MAX_REHASH) {
+        unsigned long val;
+        size_t ix;
+
+        scan = strstr(scan, use_mark);
+        if (scan == NULL)
+            break;
+        scan += sizeof(use_mark) - 1;
+        val   = strtoul(scan, NULL, 10);
+
+        for (ix = 0; ix < ct; ix++)
+            if (cts[ix] == val)
+                break;
+        if ((ix == ct) && (val > 0) && (val <= MAX_REHASH_CT))
+            cts[ct++] = val;
+    }
+
+    return ct;
+}
+
+/**
+ * Build the list of character class sets to try.  The current set is
+ * first, then the usual default, then every sensible combination of
+ * requirements and prohibitions.  Passwords shorter than MIN_PW_LEN
+ * can only be PIN numbers.
+ *
+ * @param[out] sets  the class bit sets
+ * @param[in]  max   the size of \a sets
+ * @param[in]  len   the password length
+ * @returns the number of sets
+ */
+static size_t
+which_cclass_sets(uintptr_t * sets, size_t max, size_t len)
+{
+    static uintptr_t const alpha_bits[] = {
+        0, CCLASS_ALPHA, CCLASS_UPPER, CCLASS_LOWER,
+        CCLASS_UPPER | CCLASS_LOWER,
+        CCLASS_UPPER | CCLASS_TWO_UPPER,
+        CCLASS_LOWER | CCLASS_TWO_LOWER,
+        CCLASS_UPPER | CCLASS_TWO_UPPER | CCLASS_LOWER,
+        CCLASS_UPPER | CCLASS_LOWER | CCLASS_TWO_LOWER,
+        CCLASS_UPPER | CCLASS_TWO_UPPER | CCLASS_LOWER | CCLASS_TWO_LOWER,
+        CCLASS_NO_ALPHA };
+    static uintptr_t const digit_bits[] = {
+        0, CCLASS_DIGIT, CCLASS_DIGIT | CCLASS_TWO_DIGIT };
+    static uintptr_t const spec_bits[] = {
+        0, CCLASS_SPECIAL, CCLASS_SPECIAL | CCLASS_TWO_SPECIAL,
+        CCLASS_NO_SPECIAL };
+    static uintptr_t const three_bits[] = {
+        0, CCLASS_NO_TRIPLETS, CCLASS_NO_SEQUENCE, CCLASS_NO_THREE };
+    static uintptr_t const pin_bits = CCLASS_NO_ALPHA | CCLASS_NO_SPECIAL;
+
+    size_t ct = 0;
+    size_t a, d, s, t;
+
+    if (len < MIN_PW_LEN) {
+        sets[ct++] = pin_bits | CCLASS_DIGIT;
+        return ct;
+    }
+
+    sets[ct++] = OPT_VALUE_CCLASS;
+    if (OPT_VALUE_CCLASS != (CCLASS_ALPHA | CCLASS_DIGIT))
+        sets[ct++] = CCLASS_ALPHA | CCLASS_DIGIT;
+
+#   define WHICH_ALEN(_a) (sizeof(_a) / sizeof(_a[0]))
+    for (t = 0; t < WHICH_ALEN(three_bits); t++)
+    for (s = 0; s < WHICH_ALEN(spec_bits);  s++)
+    for (d = 0; d < WHICH_ALEN(digit_bits); d++)
+    for (a = 0; a < WHICH_ALEN(alpha_bits); a++) {
+        uintptr_t bits =
+            alpha_bits[a] | digit_bits[d] | spec_bits[s] | three_bits[t];
+
+        /*
+         * PIN numbers ignore all the other classes.  Try them once.
+         */
+        if ((bits & pin_bits) == pin_bits) {
+            if ((t != 0) || (d != 1))
+                continue;
+        }
+
+        if ((bits == sets[0]) || ((ct > 1) && (bits == sets[1])))
+            continue;
+
+        if (ct >= max)
+            break;
+        sets[ct++] = bits;
+    }
+#   undef WHICH_ALEN
+
+    return ct;
+}
+
+/**
+ * Derive one hash.  Called on a worker thread:  it must only touch
+ * its own job entry.  The jobs already keep every processor busy, so
+ * Argon2 fills its lanes in this thread.
+ *
+ * @param ctx  the job array
+ * @param ix   the job index
+ */
+static void
+which_hash_job(void * ctx, size_t ix)
+{
+    which_job_t * job = (which_job_t *)ctx + ix;
+
+    job->wj_prm.gp_threads = 1;
+    job->wj_rc = gpw_derive_hash(&job->wj_prm, job->wj_hash,
+                                 sizeof(job->wj_hash));
+}
+
+/**
+ * Add a key derivation job.
+ *
+ * @param jobs     the job array (may be reallocated)
+ * @param job_ct   the number of jobs so far (incremented)
+ * @param prm      the derivation parameters, copied into the job
+ * @returns the job array
+ */
+static which_job_t *
+which_add_job(which_job_t * jobs, size_t * job_ct, gpw_params_t const * prm)
+{
+    which_job_t * job;
+
+    if ((*job_ct % 32) == 0) {
+        size_t sz = (*job_ct + 32) * sizeof(*jobs);
+        jobs = realloc(jobs, sz);
+        if (jobs == NULL)
+            nomem_err(sz, "which jobs");
+    }
+
+    job = jobs + (*job_ct)++;
+    job->wj_prm      = *prm;
+    job->wj_hash_len = gpw_hash_len(prm);
+    job->wj_rc       = GPW_OK;
+    return jobs;
+}
+
+/**
+ * Print a match:  the seed, backend, rehash count, length and the
+ * first matching character class set.
+ *
+ * @param job    the matching key derivation
+ * @param bits   the character class set
+ * @param others the count of other class sets that also match
+ */
+static void
+which_print_match(which_job_t const * job, uintptr_t bits, size_t others)
+{
+    gpw_kdf_t const kdf = gpw_kdf_used(&job->wj_prm);
+    tOptDesc *   od   = &DESC(CCLASS);
+    char const * save = od->optArg.argString;
+
+    printf(which_match_fmt, job->wj_prm.gp_tag);
+    printf(pwst_str_fmt, DESC(KDF).pz_Name, gpw_kdf_name(kdf));
+    if (kdf == GPW_KDF_SHA256)
+        printf(pwst_str_fmt, DESC(REHASH).pz_Name, not_used_z);
+    else
+        printf(pwst_dig_fmt, rehash_ct_z, (unsigned int)job->wj_prm.gp_rehash);
+    printf(pwst_dig_fmt, DESC(LENGTH).pz_Name, job->wj_prm.gp_length);
+
+    od->optCookie = (void *)bits;
+    doOptCclass(OPTPROC_RETURN_VALNAME, od);
+    printf(pwst_str_fmt, DESC(CCLASS).pz_Name, od->optArg.argString);
+    free((void *)od->optArg.argString);
+    od->optArg.argString = save;
+
+    if (others > 0)
+        printf(which_others_fmt, (unsigned int)others);
+}
+
+/**
+ * Find the seed, rehash count, key derivation function, length and
+ * character classes that produce the "--which" password for a password
+ * id.  The length is that of the password.  The "--specials" and Argon2
+ * costs in effect for the password id are used.
+ *
+ * @param pwid_prm  the derivation context of the password id
+ */
+static void
+which_pw(gpw_params_t const * pwid_prm)
+{
+    static size_t const max_sets = 600;
+
+    char const * const pw  = OPT_ARG(WHICH);
+    size_t const       len = strlen(pw);
+
+    unsigned long rehash[WHICH_MAX_REHASH];
+    size_t        rehash_ct = which_rehash_counts(rehash);
+    uintptr_t *   sets;
+    size_t        set_ct;
+    which_job_t * jobs   = NULL;
+    size_t        job_ct = 0;
+    size_t        match_ct = 0;
+    size_t        ix;
+
+    uintptr_t const save_cclass = OPT_VALUE_CCLASS;
+
+    tOptionValue const * ov = optionFindValue(&DESC(SEED), NULL, NULL);
+
+    if ((len < GPW_MIN_LENGTH) || (len > GPW_MAX_LENGTH))
+        usage_message(which_len_fmt, (unsigned int)len,
+                      GPW_MIN_LENGTH, GPW_MAX_LENGTH);
+
+    sets   = scribble_get(max_sets * sizeof(*sets));
+    set_ct = which_cclass_sets(sets, max_sets, len);
+
+    /*
+     * Each seed, with rehashing disabled and with each backend and each
+     * rehash count.  Passwords longer than the rehash limit never use
+     * the key derivation functions.
+     */
+    do  {
+        gpw_params_t prm = *pwid_prm;
+
+        if (usable_seed(ov, &prm.gp_tag, &prm.gp_text)) {
+            prm.gp_length = (unsigned int)len;
+            prm.gp_rehash = 0;
+            jobs = which_add_job(jobs, &job_ct, &prm);
+
+            /*
+             * The plain sha256 sum is queued just above.  Skip any
+             * combination that would select it again.
+             */
+            if (len <= GPW_KDF_MAX_LENGTH) {
+                int    kdf;
+                size_t rix;
+                for (kdf = GPW_KDF_SHA256 + 1; kdf < GPW_KDF_CT; kdf++)
+                    for (rix = 0; rix < rehash_ct; rix++) {
+                        prm.gp_kdf    = (gpw_kdf_t)kdf;
+                        prm.gp_rehash = rehash[rix];
+                        if (gpw_kdf_used(&prm) != GPW_KDF_SHA256)
+                            jobs = which_add_job(jobs, &job_ct, &prm);
+                    }
+            }
+        }
+
+        ov = optionFindNextValue(&DESC(SEED), ov, NULL, NULL);
+    } while (ov != NULL);
+
+    if (job_ct == 0)
+        die(GNU_PW_MGR_EXIT_NO_SEED, no_passwords,
+            ENABLED_OPT(SHARED) ? sec_pw_type : "");
+
+    parallel_for(job_ct, which_hash_job, jobs);
+
+    /*
+     * Now the cheap part:  encode each hash every way we know.
+     */
+    {
+        char * buf = scribble_get(GPW_PW_BUF_SIZE);
+
+        for (ix = 0; ix < job_ct; ix++) {
+            which_job_t const * job = jobs + ix;
+            gpw_params_t prm  = job->wj_prm;
+            size_t   found = 0;
+            uintptr_t first = 0;
+            size_t   six;
+
+            check_gpw_rc(job->wj_rc, &prm);
+
+            for (six = 0; six < set_ct; six++) {
+                gpw_err_t rc;
+
+                /*
+                 * PIN numbers are limited by the hash size, and the
+                 * specials may not settle with no-triplets or no-sequence.
+                 */
+                prm.gp_cclass = (uint32_t)sets[six];
+                rc = gpw_encode(&prm, job->wj_hash, job->wj_hash_len,
+                                buf, GPW_PW_BUF_SIZE);
+                if ((rc == GPW_ERR_PIN_LENGTH) || (rc == GPW_ERR_SPECIALS))
+                    continue;
+                check_gpw_rc(rc, &prm);
+                if (strcmp(buf, pw) != 0)
+                    continue;
+
+                if (found++ == 0)
+                    first = sets[six];
+            }
+
+            if (found > 0) {
+                which_print_match(job, first, found - 1);
+                match_ct++;
+            }
+        }
+    }
+
+    free(jobs);
+    DESC(CCLASS).optCookie = (void *)save_cclass;
+
+    if (match_ct == 0)
+        die(GNU_PW_MGR_EXIT_INVALID, which_no_match, pwid_prm->gp_pwid);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of which.c */
@@ -0,0 +1,292 @@
+/**
+ * @file alloc-count.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A malloc counter, for use with LD_PRELOAD by alloc.test.  It counts
+ * the allocations a program makes and the peak of the bytes in use.
+ * At exit, it appends "<allocations> <peak bytes>" to the file named
+ * by the ALLOC_COUNT_FILE environment variable.  Peak bytes are only
+ * known with glibc:  elsewhere, zero is reported.  A program can also
+ * look up alloc_count_total() with dlsym() and count the allocations
+ * of just one part of its run.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE 1
+#endif
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+# include <malloc.h>
+# define BLOCK_SIZE(_p)  malloc_usable_size(_p)
+#else
+# define BLOCK_SIZE(_p)  0
+#endif
+
+typedef void * (malloc_fn_t)(size_t);
+typedef void * (calloc_fn_t)(size_t, size_t);
+typedef void * (realloc_fn_t)(void *, size_t);
+typedef void   (free_fn_t)(void *);
+typedef int    (pmalign_fn_t)(void **, size_t, size_t);
+typedef void * (align_fn_t)(size_t, size_t);
+
+static malloc_fn_t *   real_malloc   = NULL;
+static calloc_fn_t *   real_calloc   = NULL;
+static realloc_fn_t *  real_realloc  = NULL;
+static free_fn_t *     real_free     = NULL;
+static pmalign_fn_t *  real_pmalign  = NULL;
+static align_fn_t *    real_aligned  = NULL;
+static align_fn_t *    real_memalign = NULL;
+static malloc_fn_t *   real_valloc   = NULL;
+
+static unsigned long   alloc_ct      = 0;
+static size_t          in_use        = 0;
+static size_t          peak_use      = 0;
+
+/*
+ * dlsym() may call calloc() before calloc() is found.
+ * Those few bytes come from here and are never freed.
+ */
+static unsigned char   boot_buf[4096];
+static size_t          boot_off      = 0;
+
+#define IS_BOOT(_p) \
+    (((unsigned char *)(_p) >= boot_buf) \
+     && ((unsigned char *)(_p) < boot_buf + sizeof(boot_buf)))
+
+static void
+find_real_fns(void)
+{
+    static int finding = 0;
+
+    if (finding++ > 0)
+        return;
+    real_malloc   = (malloc_fn_t *)  dlsym(RTLD_NEXT, "malloc");
+    real_calloc   = (calloc_fn_t *)  dlsym(RTLD_NEXT, "calloc");
+    real_realloc  = (realloc_fn_t *) dlsym(RTLD_NEXT, "realloc");
+    real_free     = (free_fn_t *)    dlsym(RTLD_NEXT, "free");
+    real_pmalign  = (pmalign_fn_t *) dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned  = (align_fn_t *)   dlsym(RTLD_NEXT, "aligned_alloc");
+    real_memalign = (align_fn_t *)   dlsym(RTLD_NEXT, "memalign");
+    real_valloc   = (malloc_fn_t *)  dlsym(RTLD_NEXT, "valloc");
+}
+
+static void
+add_use(size_t sz)
+{
+    size_t now = __atomic_add_fetch(&in_use, sz, __ATOMIC_RELAXED);
+
+    for (;;) {
+        size_t pk = __atomic_load_n(&peak_use, __ATOMIC_RELAXED);
+        if (  (now <= pk)
+           || __atomic_compare_exchange_n(&peak_use, &pk, now, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+    }
+}
+
+static void
+count_alloc(void * p)
+{
+    if (p == NULL)
+        return;
+    __atomic_add_fetch(&alloc_ct, 1, __ATOMIC_RELAXED);
+    add_use(BLOCK_SIZE(p));
+}
+
+static void
+count_free(void * p)
+{
+    if (p != NULL)
+        __atomic_sub_fetch(&in_use, BLOCK_SIZE(p), __ATOMIC_RELAXED);
+}
+
+void *
+malloc(size_t sz)
+{
+    void * p;
+
+    if (real_malloc == NULL)
+        find_real_fns();
+    p = real_malloc(sz);
+    count_alloc(p);
+    return p;
+}
+
+void *
+calloc(size_t ct, size_t sz)
+{
+    void * p;
+
+    if (real_calloc == NULL) {
+        size_t len = (ct * sz + 15) & ~(size_t)15;
+
+        find_real_fns();
+        if (real_calloc == NULL) {
+            if (boot_off + len > sizeof(boot_buf))
+                return NULL;
+            p = boot_buf + boot_off;
+            boot_off += len;
+            return p; // static storage is already zeroed
+        }
+    }
+
+    p = real_calloc(ct, sz);
+    count_alloc(p);
+    return p;
+}
+
+void *
+realloc(void * old, size_t sz)
+{
+    size_t old_sz;
+    void * p;
+
+    if (real_realloc == NULL)
+        find_real_fns();
+
+    if (IS_BOOT(old)) {
+        p = malloc(sz);
+        if (p != NULL)
+            memcpy(p, old, (sz < sizeof(boot_buf)) ? sz : sizeof(boot_buf));
+        return p;
+    }
+
+    /*
+     * A moved block is a new allocation.  One resized in place is not.
+     */
+    old_sz = (old == NULL) ? 0 : BLOCK_SIZE(old);
+    p = real_realloc(old, sz);
+    if (p == NULL)
+        return NULL;
+
+    __atomic_sub_fetch(&in_use, old_sz, __ATOMIC_RELAXED);
+    if (p == old)
+        add_use(BLOCK_SIZE(p));
+    else
+        count_alloc(p);
+    return p;
+}
+
+int
+posix_memalign(void ** res, size_t align, size_t sz)
+{
+    int rc;
+
+    if (real_pmalign == NULL)
+        find_real_fns();
+    rc = real_pmalign(res, align, sz);
+    if (rc == 0)
+        count_alloc(*res);
+    return rc;
+}
+
+void *
+aligned_alloc(size_t align, size_t sz)
+{
+    void * p;
+
+    if (real_aligned == NULL)
+        find_real_fns();
+    p = real_aligned(align, sz);
+    count_alloc(p);
+    return p;
+}
+
+void *
+memalign(size_t align, size_t sz)
+{
+    void * p;
+
+    if (real_memalign == NULL)
+        find_real_fns();
+    p = real_memalign(align, sz);
+    count_alloc(p);
+    return p;
+}
+
+void *
+valloc(size_t sz)
+{
+    void * p;
+
+    if (real_valloc == NULL)
+        find_real_fns();
+    p = real_valloc(sz);
+    count_alloc(p);
+    return p;
+}
+
+void
+free(void * p)
+{
+    if ((p == NULL) || IS_BOOT(p))
+        return;
+    if (real_free == NULL)
+        find_real_fns();
+    count_free(p);
+    real_free(p);
+}
+
+/**
+ * @returns the count of allocations so far.
+ */
+unsigned long
+alloc_count_total(void)
+{
+    return __atomic_load_n(&alloc_ct, __ATOMIC_RELAXED);
+}
+
+static void __attribute__((destructor))
+report_counts(void)
+{
+    char const * fname = getenv("ALLOC_COUNT_FILE");
+    char         line[64];
+    int          fd, len;
+
+    if (fname == NULL)
+        return;
+
+    fd = open(fname, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    if (fd < 0)
+        return;
+
+    len = snprintf(line, sizeof(line), "%lu %lu\n",
+                   alloc_ct, (unsigned long)peak_use);
+    if ((len > 0) && (write(fd, line, (size_t)len) != len))
+        len = 0;
+    close(fd);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of alloc-count.c */
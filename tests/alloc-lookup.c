@@ -0,0 +1,149 @@
+/**
+ * @file alloc-lookup.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Check that a password lookup does not touch the heap once the program
+ * is running.  It is run by alloc.test with the liballoc-count malloc
+ * counter preloaded.  One round of derivations and encodings warms up,
+ * then ALLOC_LOOKUP_ROUNDS more must not allocate at all.  Argon2id is
+ * left out:  it allocates the memory it is made to be hard on.
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE 1
+#endif
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gnupwmgr.h"
+
+#define ALLOC_LOOKUP_ROUNDS     10
+#define ALLOC_LOOKUP_SKIP       77  ///< automake "test skipped" status
+
+typedef unsigned long (alloc_count_fn_t)(void);
+
+static uint32_t const lookup_cclass[] = {
+    GPW_CCLASS_DEFAULT,
+    GPW_CCLASS_UPPER | GPW_CCLASS_LOWER | GPW_CCLASS_DIGIT
+        | GPW_CCLASS_SPECIAL,
+    GPW_CCLASS_ALNUM | GPW_CCLASS_NO_THREE,
+    GPW_CCLASS_TWO_UPPER | GPW_CCLASS_TWO_LOWER | GPW_CCLASS_TWO_DIGIT
+        | GPW_CCLASS_TWO_SPECIAL,
+    GPW_CCLASS_NO_ALPHA | GPW_CCLASS_DIGIT | GPW_CCLASS_SPECIAL,
+    GPW_CCLASS_PIN
+};
+
+#define LOOKUP_CCLASS_CT (sizeof(lookup_cclass) / sizeof(lookup_cclass[0]))
+
+/**
+ * Look up the passwords for one password id the way gnu-pw-mgr does:
+ * derive once per key derivation function, then encode with each set of
+ * character classes and make a confirmation answer.
+ *
+ * @returns the count of calls that failed
+ */
+static unsigned int
+lookup_round(void)
+{
+    unsigned int fails = 0;
+    int          kdf;
+
+    for (kdf = GPW_KDF_SHA256; kdf < GPW_KDF_ARGON2ID; kdf++) {
+        gpw_params_t  prm;
+        unsigned char hash[GPW_HASH_MAX];
+        char          pw[GPW_PW_BUF_SIZE];
+        size_t        ix;
+
+        gpw_params_init(&prm);
+        prm.gp_tag    = "TEST ONLY TAG";
+        prm.gp_text   = "This is only a test.  Were it real, you would "
+                        "likely know.  It is not.";
+        prm.gp_pwid   = "who";
+        prm.gp_kdf    = (kdf == GPW_KDF_SHA256) ? GPW_KDF_PBKDF2_SHA1
+                                                : (gpw_kdf_t)kdf;
+        prm.gp_rehash = (kdf == GPW_KDF_SHA256) ? 0 : 100;
+
+        if (gpw_derive_hash(&prm, hash, sizeof(hash)) != GPW_OK)
+            fails++;
+
+        for (ix = 0; ix < LOOKUP_CCLASS_CT; ix++) {
+            prm.gp_cclass = lookup_cclass[ix];
+            prm.gp_length = (lookup_cclass[ix] == GPW_CCLASS_PIN) ? 6 : 24;
+            if (gpw_encode(&prm, hash, gpw_hash_len(&prm),
+                           pw, sizeof(pw)) != GPW_OK)
+                fails++;
+        }
+
+        prm.gp_cclass = GPW_CCLASS_DEFAULT;
+        prm.gp_length = GPW_DFT_LENGTH;
+        if (gpw_derive(&prm, pw, sizeof(pw)) != GPW_OK)
+            fails++;
+
+        prm.gp_confirm = "pet";
+        if (gpw_confirm_answer(&prm, NULL, 0, pw, sizeof(pw)) != GPW_OK)
+            fails++;
+    }
+
+    return fails;
+}
+
+int
+main(int argc, char ** argv)
+{
+    alloc_count_fn_t * count_fn =
+        (alloc_count_fn_t *)dlsym(RTLD_DEFAULT, "alloc_count_total");
+    unsigned long      start;
+    unsigned int       fails;
+    int                ix;
+
+    (void)argc;
+    (void)argv;
+
+    if (count_fn == NULL) {
+        printf("alloc-lookup: skipped:  the malloc counter is not loaded\n");
+        return ALLOC_LOOKUP_SKIP;
+    }
+
+    fails = lookup_round();
+    start = count_fn();
+    for (ix = 0; ix < ALLOC_LOOKUP_ROUNDS; ix++)
+        fails += lookup_round();
+    start = count_fn() - start;
+
+    if (fails > 0)
+        printf("alloc-lookup: %u derivations failed\n", fails);
+    printf("alloc-lookup: %lu allocations in %d lookup rounds\n",
+           start, ALLOC_LOOKUP_ROUNDS);
+
+    return ((fails == 0) && (start == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of alloc-lookup.c */
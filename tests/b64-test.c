@@ -0,0 +1,135 @@
+/**
+ * @file b64-test.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Check every base64 encoder the CPU can run against gnulib.  Every one
+ * of the 2^24 three byte groups is encoded and decoded again.  Then every
+ * input length up to B64_TEST_MAX_LEN is encoded into every output size
+ * up to the full length plus two, and must match base64_encode() byte for
+ * byte, including the NUL and the bytes left untouched.
+ */
+
+#include "lib-fwd.h"
+
+#define B64_TEST_MAX_LEN    200
+#define B64_TEST_GROUPS     32      ///< three byte groups per call
+#define B64_TEST_FILL       0x5A
+
+static char const * const b64_test_names[] = {
+    [B64_IMPL_SCALAR] = "scalar",
+    [B64_IMPL_SSSE3]  = "ssse3",
+    [B64_IMPL_AVX2]   = "avx2"
+};
+
+static unsigned long b64_test_fails = 0;
+
+static void
+b64_test_fail(b64_impl_t impl, char const * what, size_t inlen, size_t outlen)
+{
+    if (b64_test_fails++ < 10)
+        fprintf(stderr, "b64-test %s: %s, input length %zu, output size %zu\n",
+                b64_test_names[impl], what, inlen, outlen);
+}
+
+/**
+ * Encode and decode every three byte group.
+ */
+static void
+b64_test_groups(b64_impl_t impl)
+{
+    char     in[B64_TEST_GROUPS * 3];
+    char     out[BASE64_LENGTH(sizeof(in)) + 1];
+    char     back[sizeof(in)];
+    uint32_t val = 0;
+
+    do  {
+        size_t blen = sizeof(back);
+        int    ix;
+
+        for (ix = 0; ix < B64_TEST_GROUPS; ix++, val++) {
+            in[3 * ix + 0] = (char)(val >> 16);
+            in[3 * ix + 1] = (char)(val >> 8);
+            in[3 * ix + 2] = (char)val;
+        }
+
+        b64_encode_impl(impl, in, sizeof(in), out, sizeof(out));
+        if (  ! base64_decode(out, sizeof(out) - 1, back, &blen)
+           || (blen != sizeof(in)) || (memcmp(back, in, sizeof(in)) != 0))
+            b64_test_fail(impl, "round trip", sizeof(in), sizeof(out));
+    } while (val < (1UL << 24));
+}
+
+/**
+ * Compare with base64_encode() for every input length and output size.
+ */
+static void
+b64_test_lengths(b64_impl_t impl)
+{
+    unsigned char in[B64_TEST_MAX_LEN];
+    char          want[BASE64_LENGTH(B64_TEST_MAX_LEN) + 8];
+    char          got[sizeof(want)];
+    size_t        inlen, outlen;
+    uint32_t      rnd = 0x2545F491;
+
+    for (inlen = 0; inlen < sizeof(in); inlen++) {
+        rnd = rnd * 1103515245 + 12345;
+        in[inlen] = (unsigned char)(rnd >> 16);
+    }
+
+    for (inlen = 0; inlen <= B64_TEST_MAX_LEN; inlen++) {
+        for (outlen = 0; outlen <= BASE64_LENGTH(inlen) + 2; outlen++) {
+            memset(want, B64_TEST_FILL, sizeof(want));
+            memset(got,  B64_TEST_FILL, sizeof(got));
+            base64_encode((char const *)in, inlen, want, outlen);
+            b64_encode_impl(impl, (char const *)in, inlen, got, outlen);
+            if (memcmp(want, got, sizeof(want)) != 0)
+                b64_test_fail(impl, "differs from gnulib", inlen, outlen);
+        }
+    }
+}
+
+int
+main(int argc, char ** argv)
+{
+    b64_impl_t best = b64_best_impl();
+    int        impl;
+
+    (void)argc;
+    (void)argv;
+
+    for (impl = B64_IMPL_SCALAR; impl <= (int)best; impl++) {
+        b64_test_groups((b64_impl_t)impl);
+        b64_test_lengths((b64_impl_t)impl);
+        printf("%-7s %s\n", b64_test_names[impl],
+               (b64_test_fails == 0) ? "ok" : "FAILED");
+    }
+
+    return (b64_test_fails == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of b64-test.c */
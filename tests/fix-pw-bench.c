@@ -0,0 +1,420 @@
+/**
+ * @file fix-pw-bench.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A benchmark and fuzz target for the password fixups.  Synthetic hashes
+ * are encoded with gpw_encode() for every distinct "--cclass" setting,
+ * which runs fix_std_pw(), fix_no_alpha_pw() or fix_digit_pw().  The
+ * "confirm" line is gpw_confirm_answer(), which runs fix_lower_only_pw().
+ * For each, it reports:
+ *
+ *   - the passwords encoded per second and the nanoseconds for each,
+ *   - how often the fixup changed the plain base64 text,
+ *   - a histogram of the fix_std_pw() counting passes, and
+ *   - the most clean_no_three() passes any password took.
+ *
+ * The hash needing the most passes is printed at the end.
+ *
+ *   make -C tests fix-pw-bench
+ *   tests/fix-pw-bench [-n count] [-l length] [-s specials] [-c cclass]
+ *
+ * Built with -DFIX_PW_FUZZ, it is a libFuzzer target instead:
+ *
+ *   clang -g -O1 -fsanitize=fuzzer,address -DFIX_PW_FUZZ \
+ *       -I lib -I src tests/fix-pw-bench.c lib/.libs/libgnu.a
+ *
+ * The input picks the settings and the hash.  It aborts if a password
+ * has the wrong length or characters, or the fixup does not settle.
+ */
+
+typedef struct {
+    unsigned long   count;          ///< count_pw_class() passes
+    unsigned long   clean;          ///< clean_no_three() passes
+} bench_passes_t;
+
+static bench_passes_t bench_passes;
+
+#define FIX_PW_PASS(_kind)  (bench_passes._kind++)
+
+#include "libgnupwmgr.c"
+
+#include <time.h>
+
+#define BENCH_DFT_COUNT     100000
+#define BENCH_BATCH         1024
+#define BENCH_HIST_CT       5       ///< 1, 2, 3, 4 and more passes
+#define BENCH_CCLASS_BITS   15
+
+typedef struct {
+    uint32_t        br_cclass;      ///< normalized GPW_CCLASS_* bits
+    unsigned long   br_count;       ///< passwords encoded
+    unsigned long   br_changed;     ///< fixups that changed something
+    double          br_nsec;        ///< time in the fixup calls
+    unsigned long   br_hist[BENCH_HIST_CT];
+    unsigned long   br_max_clean;   ///< most clean passes for one
+} bench_result_t;
+
+static char const * const bench_cclass_names[BENCH_CCLASS_BITS] = {
+    "alpha", "upper", "lower", "digit", "special", "no-special",
+    "no-alpha", "no-triplets", "no-sequence", "pin", "alnum",
+    "two-upper", "two-lower", "two-digit", "two-special"
+};
+
+static uint64_t bench_rand_state = 0x9E3779B97F4A7C15ULL;
+
+static unsigned long bench_worst_ct = 0;
+static uint32_t      bench_worst_cclass;
+static unsigned char bench_worst_hash[GPW_HASH_MAX];
+
+static uint64_t
+bench_rand(void)
+{
+    bench_rand_state ^= bench_rand_state << 13;
+    bench_rand_state ^= bench_rand_state >> 7;
+    bench_rand_state ^= bench_rand_state << 17;
+    return bench_rand_state;
+}
+
+/**
+ * Fill in synthetic hashes.
+ */
+static void
+bench_hashes(unsigned char * hash, size_t len)
+{
+    while (len >= sizeof(uint64_t)) {
+        uint64_t r = bench_rand();
+        memcpy(hash, &r, sizeof(r));
+        hash += sizeof(r);
+        len  -= sizeof(r);
+    }
+}
+
+/**
+ * Print the names of the bits in a cclass.
+ *
+ * @returns the number of characters printed
+ */
+static int
+bench_print_cclass(uint32_t cc)
+{
+    int ct = 0;
+    int ix;
+
+    if (cc == 0)
+        return printf("none");
+
+    for (ix = 0; ix < BENCH_CCLASS_BITS; ix++) {
+        if ((cc & (1U << ix)) == 0)
+            continue;
+        ct += printf("%s%s", (ct == 0) ? "" : "+", bench_cclass_names[ix]);
+    }
+    return ct;
+}
+
+/**
+ * Encode \a count synthetic hashes with one cclass setting.
+ *
+ * @param[in,out] res   the results.  \a br_cclass is set.
+ * @param[in]     prm   the encoding parameters, without the cclass
+ * @param[in]     count the number of passwords to encode
+ * @param[in]     confirm  true to make confirmation answers instead
+ * @returns false if gpw_encode() rejects the setting
+ */
+static bool
+bench_one(bench_result_t * res, gpw_params_t prm, unsigned long count,
+          bool confirm)
+{
+    static unsigned char  hashes[BENCH_BATCH][GPW_HASH_MAX];
+    static char           pws[BENCH_BATCH][GPW_PW_BUF_SIZE];
+    static bench_passes_t passes[BENCH_BATCH];
+
+    size_t hash_len = gpw_hash_len(&prm);
+    size_t len      = confirm ? GPW_CONFIRM_LEN : prm.gp_length;
+
+    prm.gp_cclass = res->br_cclass;
+
+    while (res->br_count < count) {
+        struct timespec start, end;
+        int             ct = BENCH_BATCH;
+        int             ix;
+
+        if (count - res->br_count < BENCH_BATCH)
+            ct = (int)(count - res->br_count);
+        bench_hashes(hashes[0], sizeof(hashes));
+
+        /*
+         * Time the whole batch.  Only the pass counts are kept here.
+         */
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (ix = 0; ix < ct; ix++) {
+            gpw_err_t rc;
+
+            memset(&bench_passes, 0, sizeof(bench_passes));
+            rc = confirm
+                ? gpw_confirm_answer(&prm, hashes[ix], hash_len,
+                                     pws[ix], sizeof(pws[ix]))
+                : gpw_encode(&prm, hashes[ix], hash_len,
+                             pws[ix], sizeof(pws[ix]));
+            if (rc != GPW_OK)
+                return false;
+            passes[ix] = bench_passes;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        res->br_nsec  += ((end.tv_sec - start.tv_sec) * 1e9)
+            + (end.tv_nsec - start.tv_nsec);
+        res->br_count += (unsigned long)ct;
+
+        for (ix = 0; ix < ct; ix++) {
+            char          plain[GPW_PW_BUF_SIZE];
+            unsigned long pct = passes[ix].count;
+
+            b64_encode((char const *)hashes[ix], hash_len, plain,
+                       sizeof(plain));
+            plain[len] = NUL;
+            if (strcmp(pws[ix], plain) != 0)
+                res->br_changed++;
+
+            if (pct > 0)
+                res->br_hist[(pct < BENCH_HIST_CT) ? pct - 1
+                             : BENCH_HIST_CT - 1]++;
+            if (passes[ix].clean > res->br_max_clean)
+                res->br_max_clean = passes[ix].clean;
+
+            if (pct + passes[ix].clean > bench_worst_ct) {
+                bench_worst_ct     = pct + passes[ix].clean;
+                bench_worst_cclass = res->br_cclass;
+                memcpy(bench_worst_hash, hashes[ix], hash_len);
+            }
+        }
+    }
+
+    return true;
+}
+
+static void
+bench_report(bench_result_t const * res, bool confirm)
+{
+    int ct = confirm ? printf("confirm") : bench_print_cclass(res->br_cclass);
+    int ix;
+
+    printf("%*s %9.0f %7.1f %7.3f%%",
+           (ct < 56) ? 56 - ct : 0, "",
+           res->br_count * 1e9 / res->br_nsec,
+           res->br_nsec / res->br_count,
+           (100.0 * res->br_changed) / res->br_count);
+
+    for (ix = 0; ix < BENCH_HIST_CT; ix++)
+        printf(" %8lu", res->br_hist[ix]);
+    printf(" %5lu\n", res->br_max_clean);
+}
+
+/**
+ * Add a cclass setting to the list, unless it is already there.
+ */
+static int
+bench_add_cclass(uint32_t * list, int ct, uint32_t cc)
+{
+    int ix;
+
+    for (ix = 0; ix < ct; ix++)
+        if (list[ix] == cc)
+            return ct;
+    list[ct] = cc;
+    return ct + 1;
+}
+
+static int
+bench_cmp_cclass(void const * l, void const * r)
+{
+    uint32_t a = *(uint32_t const *)l;
+    uint32_t b = *(uint32_t const *)r;
+    return (a < b) ? -1 : (a > b);
+}
+
+#ifndef FIX_PW_FUZZ
+static void
+bench_usage(char const * prog)
+{
+    fprintf(stderr, "usage: %s [-n count] [-l length] [-s specials] "
+            "[-c cclass-bits] [-r seed]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int
+main(int argc, char ** argv)
+{
+    static uint32_t cclass_list[1U << BENCH_CCLASS_BITS];
+
+    unsigned long count  = BENCH_DFT_COUNT;
+    long          one_cc = -1;
+    int           cc_ct  = 0;
+    gpw_params_t  prm;
+    uint32_t      bits;
+    int           opt, ix;
+
+    gpw_params_init(&prm);
+
+    while ((opt = getopt(argc, argv, "n:l:s:c:r:")) != -1) {
+        switch (opt) {
+        case 'n': count          = strtoul(optarg, NULL, 0); break;
+        case 'l': prm.gp_length  = (unsigned int)strtoul(optarg, NULL, 0);
+                  break;
+        case 's': prm.gp_specials = optarg;                  break;
+        case 'c': one_cc         = strtol(optarg, NULL, 0);  break;
+        case 'r': bench_rand_state = strtoull(optarg, NULL, 0) | 1; break;
+        default:  bench_usage(argv[0]);
+        }
+    }
+
+    /*
+     * Every combination of the keyword bits, reduced to the distinct
+     * settings the encoder sees.
+     */
+    for (bits = 0; bits < (1U << BENCH_CCLASS_BITS); bits++) {
+        uint32_t cc = bits;
+
+        if ((one_cc >= 0) && (bits != (uint32_t)one_cc))
+            continue;
+        if (lib_fix_cclass(&cc))
+            cc_ct = bench_add_cclass(cclass_list, cc_ct, cc);
+    }
+    qsort(cclass_list, (size_t)cc_ct, sizeof(*cclass_list), bench_cmp_cclass);
+
+    printf("%lu synthetic hashes, length %u, specials '%s'\n\n"
+           "%-56s %9s %7s %8s %8s %8s %8s %8s %8s %5s\n",
+           count, prm.gp_length,
+           (prm.gp_specials != NULL) ? prm.gp_specials : GPW_DFT_SPECIALS,
+           "cclass", "pw/sec", "ns/pw", "changed",
+           "1 pass", "2", "3", "4", "more", "clean");
+
+    for (ix = 0; ix < cc_ct; ix++) {
+        bench_result_t res = { .br_cclass = cclass_list[ix] };
+
+        if (bench_one(&res, prm, count, false))
+            bench_report(&res, false);
+        else {
+            bench_print_cclass(res.br_cclass);
+            printf(":  rejected for length %u\n", prm.gp_length);
+        }
+    }
+
+    {
+        bench_result_t res = { .br_cclass = 0 };
+
+        prm.gp_pwid    = "bench id";
+        prm.gp_confirm = "bench question";
+        if (bench_one(&res, prm, count, true))
+            bench_report(&res, true);
+    }
+
+    if (bench_worst_ct > 0) {
+        size_t hlen = gpw_hash_len(&prm);
+
+        printf("\nmost passes:  %lu for ", bench_worst_ct);
+        bench_print_cclass(bench_worst_cclass);
+        printf(" with hash\n    ");
+        for (ix = 0; ix < (int)hlen; ix++)
+            printf("%02X", bench_worst_hash[ix]);
+        putchar('\n');
+    }
+
+    return EXIT_SUCCESS;
+}
+
+#else // FIX_PW_FUZZ
+
+extern int
+LLVMFuzzerTestOneInput(uint8_t const * data, size_t size);
+
+/**
+ * Fuzz input:  two bytes of cclass bits, one byte of length, three
+ * special characters and then the hash.
+ */
+int
+LLVMFuzzerTestOneInput(uint8_t const * data, size_t size)
+{
+    unsigned char hash[GPW_HASH_MAX] = { 0 };
+    char          spec[4];
+    char          pw[GPW_PW_BUF_SIZE];
+    gpw_params_t  prm;
+    size_t        hash_len, ix;
+
+    if (size < 6 + 256 / NBBY)
+        return 0;
+
+    gpw_params_init(&prm);
+    prm.gp_cclass  = ((uint32_t)data[0] | ((uint32_t)data[1] << 8))
+        & ((1U << BENCH_CCLASS_BITS) - 1);
+    prm.gp_length  = GPW_MIN_LENGTH
+        + (data[2] % (GPW_MAX_LENGTH - GPW_MIN_LENGTH + 1));
+    memcpy(spec, data + 3, 3);
+    spec[3] = NUL;
+    if (strlen(spec) != 3)
+        return 0;
+    prm.gp_specials = spec;
+
+    /*
+     * gpw_encode() does not check that the hash has enough base64 text
+     * for the length.  Longer passwords end in '=' and whatever was in
+     * the buffer, so they are not tried here.
+     */
+    hash_len = gpw_hash_len(&prm);
+    if (prm.gp_length > (hash_len * 4) / 3)
+        return 0;
+    memcpy(hash, data + 6, (size - 6 < hash_len) ? size - 6 : hash_len);
+
+    memset(&bench_passes, 0, sizeof(bench_passes));
+    if (gpw_encode(&prm, hash, hash_len, pw, sizeof(pw)) != GPW_OK)
+        return 0;
+
+    if (  (strlen(pw) != prm.gp_length)
+       || (bench_passes.count > FIX_PW_MAX_ROUNDS)
+       || (bench_passes.clean > FIX_PW_MAX_ROUNDS * FIX_PW_MAX_ROUNDS))
+        abort();
+
+    for (ix = 0; ix < prm.gp_length; ix++) {
+        unsigned char ch = (unsigned char)pw[ix];
+        if (! isalnum(ch) && (strchr(spec, ch) == NULL)
+           && (ch != '+') && (ch != '/'))
+            abort();
+    }
+
+    prm.gp_pwid    = "fuzz id";
+    prm.gp_confirm = "fuzz question";
+    if (gpw_confirm_answer(&prm, hash, hash_len, pw, sizeof(pw)) != GPW_OK)
+        abort();
+    for (ix = 0; ix < GPW_CONFIRM_LEN; ix++)
+        if (! islower((unsigned char)pw[ix]))
+            abort();
+
+    return 0;
+}
+#endif // FIX_PW_FUZZ
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of fix-pw-bench.c */
@@ -0,0 +1,705 @@
+/**
+ * @file fix-pw-prop.c
+ *
+ *  This file is part of gnu-pw-mgr.
+ *
+ *  Copyright (C) 2013-2020 Bruce Korb, all rights reserved.
+ *  This is free software. It is licensed for use, modification and
+ *  redistribution under the terms of the GNU General Public License,
+ *  version 3 or later <http://gnu.org/licenses/gpl.html>
+ *
+ *  gpw is free software: you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  gpw is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * A property test for fix_std_pw().  Random base64 text is fixed up with
+ * random character class requirements and special characters, once by
+ * fix_std_pw() and once by a copy of the fix-pw.c fixup routines from
+ * before they were reworked.  The results must be the same, and
+ * fix_std_pw() must report running out of rounds whenever the old
+ * routines never settle.  FIX_PW_PROP_COUNT sets the number of cases
+ * (default 2000000) and FIX_PW_PROP_SEED the starting point.
+ */
+
+#include "lib-fwd.h"
+
+#define PROP_DFT_COUNT  2000000
+#define REF_MAX_ROUNDS  1000
+
+static bool ref_gave_up;
+
+static uint64_t prop_rand_state = 0x139408DCBBF7A44ULL;
+
+static char const prop_b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static char const prop_spec[] = "/+-!@#$%.~_";
+
+static uint64_t
+prop_rand(void)
+{
+    prop_rand_state ^= prop_rand_state << 13;
+    prop_rand_state ^= prop_rand_state >> 7;
+    prop_rand_state ^= prop_rand_state << 17;
+    return prop_rand_state;
+}
+
+/*
+ * The fixup routines of fix-pw.c as they were before fix_std_pw() got
+ * its class table and its single counting pass.  They are copied as
+ * they were, with a "ref_" or "REF_" prefix on each name.  The only
+ * other changes are marked "[test]".
+ */
+
+typedef enum { REF_CC_UPPER, REF_CC_LOWER, REF_CC_DIGIT, REF_CC_SPECIAL, REF_CT_CC } ref_ccl_t;
+
+/**
+ *  Make sure than any triple characters get fiddled into something with
+ *  at most two same characters in a row.
+ *
+ * @param[in,out] pw  the password string
+ * @param[in]  sequence  true if sequences are disallowed, too
+ * @param[in]  spec      the three special characters
+ * @returns true -> all done, false otherwise
+ */
+static bool
+ref_clean_triplets(char * pw, bool sequence, char const * spec)
+{
+    bool res = true;
+    unsigned char last = *(pw++);
+    if (last == NUL)
+        return res;
+
+    for (;; pw++) {
+        if (*pw == NUL)
+            return res;
+
+        if (*pw != last) {
+            last = *pw;
+            continue;
+        }
+
+        if (*(++pw) == NUL)
+            return res;
+
+        if (*pw != last) {
+            last = *pw;
+            continue;
+        }
+
+        /*
+         * Three in a row.  Alter the character under the pointer and
+         * set "last" to that new character.
+         */
+        if (isdigit(last)) {
+            if (last++ == '9')
+                last = '0';
+
+        } else if (isupper(last)) {
+            if (last++ == 'Z')
+                last = 'A';
+
+        } else if (islower(last)) {
+            if (last++ == 'z')
+                last = 'a';
+
+        } else
+            /*
+             * New rule: if sequences are disallowed, then the third
+             * repeated special char becomes 'm'. We otherwise could
+             * (theoretically) get into an infinite loop.
+             */
+            last = sequence ? 'm' : spec[2];
+
+        *pw = last;
+        res = false;
+    }
+}
+
+/**
+ *  Make sure that no three characters are sequential.
+ *
+ * @param[in,out] pw  the password string
+ * @param[in]  spec      the three special characters
+ * @returns true -> all done, false otherwise
+ */
+static bool
+ref_clean_sequence(char * pw, char const * spec)
+{
+    bool res = true;
+    unsigned char last[2];
+
+    last[1] = *(pw++);
+    if ((last[1] == NUL) || (*pw == NUL))
+        return res;
+
+    /*
+     * Until we hit a NUL byte, check current and previous two chars for
+     * a sequence.
+     */
+    while (last[0] = last[1], last[1] = *(pw++), *pw != NUL) {
+        if (*pw != last[1]+1)
+            continue; // current does not follow previous
+
+        if (last[1] != last[0]+1)
+            continue; // two previous not sequential
+
+        /*
+         * We have a triplet sequence. Flip the previous char.
+         */
+        if (isdigit(last[1])) {
+            pw[-1] += (last[1] < '5') ? 5 : -5; // rotate digit 5
+
+        } else if (isupper(last[1])) { // shift upper case by 4
+            char ch = last[1] + 4;
+            if (ch > 'Z')
+                ch = 'A' + (ch - 'Z' - 1);
+            pw[-1] = ch;
+
+        } else if (islower(last[1])) { // shift lower case by 4
+            char ch = last[1] + 4;
+            if (ch > 'z')
+                ch = 'a' + (ch - 'z' - 1);
+            pw[-1] = ch;
+
+        } else { // select alternate special char
+            /*
+             * We have three chars in a row with the middle one a special.
+             * Pick another of the three special chars.
+             */
+            pw[-1] = (last[1] != spec[2]) ? spec[2] : spec[1];
+        }
+        res = false;
+    }
+
+    return res;
+}
+
+/**
+ *  Make sure than any triple characters get fiddled into something with
+ *  at most two same characters in a row.
+ *
+ * @param[in,out] pw  the password string
+ * @param[in]  cclass    the GPW_CCLASS_* requirements
+ * @param[in]  spec      the three special characters
+ *
+ * [test] Some "--specials" values never settle, so this gives up after
+ * REF_MAX_ROUNDS rounds and sets ref_gave_up.
+ */
+static bool
+ref_clean_no_three(char * pw, uint32_t cclass, char const * spec)
+{
+    bool triplets = (cclass & GPW_CCLASS_NO_TRIPLETS) ? true : false;
+    bool sequence = (cclass & GPW_CCLASS_NO_SEQUENCE) ? true : false;
+    bool done     = false;
+    bool did_work = false;
+    int  rounds   = REF_MAX_ROUNDS; // [test]
+
+    assert(triplets || sequence);
+
+    /*
+     * Loop until both ref_clean_triplets() and ref_clean_sequence() return true.
+     */
+    while (! done) {
+        bool unchanged = false;
+        if (! triplets)
+            done = true;
+        else
+            done = unchanged = ref_clean_triplets(pw, sequence, spec);
+
+        if (sequence) {
+            done = ref_clean_sequence(pw, spec);
+            unchanged |= done;
+        }
+
+        if (UNLIKELY(! unchanged))
+            did_work = true;
+
+        if (--rounds <= 0) { // [test]
+            ref_gave_up = true;
+            return false;
+        }
+    }
+
+    return did_work;
+}
+
+/**
+ * The character was a special character, but special characters are
+ * not allowed.  Therefore, choose a digit, upper or lower case character.
+ *
+ * @param[in]       ccls  the character classes found to this point
+ * @param[in,out]   pch   pointer to the punctuation char to replace
+ *
+ * @returns the new character class set
+ */
+static uint32_t
+ref_pick_something(uint32_t ccls, char * pch, int * cta)
+{
+    if ((ccls & GPW_CCLASS_DIGIT) == 0) {
+        *pch = '0' + (*pch & 0x07);
+        cta[REF_CC_DIGIT]++;
+        return GPW_CCLASS_DIGIT;
+    }
+
+    if ((ccls & GPW_CCLASS_UPPER) == 0) {
+        *pch = 'A' + (*pch & 0x0F);
+        cta[REF_CC_UPPER]++;
+        return GPW_CCLASS_ALPHA | GPW_CCLASS_UPPER;
+    }
+
+    if ((ccls & GPW_CCLASS_LOWER) == 0) {
+        *pch = 'a' + (*pch & 0x0F);
+        cta[REF_CC_LOWER]++;
+        return GPW_CCLASS_ALPHA | GPW_CCLASS_LOWER;
+    }
+
+    if ((ccls & GPW_CCLASS_TWO_DIGIT) == 0) {
+        *pch = '0' + (*pch & 0x07);
+        cta[REF_CC_DIGIT]++;
+        return GPW_CCLASS_TWO_DIGIT;
+    }
+
+    if ((ccls & GPW_CCLASS_TWO_UPPER) == 0) {
+        *pch = 'A' + (*pch & 0x0F);
+        cta[REF_CC_UPPER]++;
+        return GPW_CCLASS_ALPHA | GPW_CCLASS_TWO_UPPER;
+    }
+
+    /*
+     *  Once we have one lower, two digits and two uppers, the rest
+     *  will be lower case.  It would be pretty rare :)
+     */
+    *pch = 'a' + (*pch & 0x0F);
+    cta[REF_CC_LOWER]++;
+    return GPW_CCLASS_ALPHA | GPW_CCLASS_TWO_LOWER;
+}
+
+/**
+ * Count the  character classes in the proposed password.
+ *
+ * @param[in] pw            the proposed password
+ * @param[in] cclass        the GPW_CCLASS_* requirements.  If special
+ *                          characters are allowed, '+' and '/' are mapped
+ *                          to the first two of \a spec.
+ * @param[in] spec          the three special characters
+ * @param[out] cta          array of character class counts
+ *
+ * @returns the mask of the classes of characters found in \a pw.
+ *
+ *  The disallowed character classes are always "found",
+ * other than the GPW_CCLASS_NO_ALPHA class. That implies all digits and
+ * is handled elsewhere.
+ */
+static uint32_t
+ref_count_pw_class(char * pw, uint32_t cclass, char const * spec, int * cta)
+{
+    static uint32_t const never = GPW_CCLASS_NO_SPECIAL | GPW_CCLASS_NO_THREE;
+
+    bool const no_spec = (cclass & GPW_CCLASS_NO_SPECIAL) != 0;
+    uint32_t   res     = cclass & never;
+    char *     scan    = pw;
+
+    memset(cta, NUL, REF_CT_CC * sizeof(*cta));
+
+    for (;;) {
+        unsigned char ch = (unsigned char)*(scan++);
+        if (ch == NUL)
+            return res;
+
+        if (isdigit(ch)) {
+            cta[REF_CC_DIGIT]++;
+            if ((res & GPW_CCLASS_DIGIT) != 0)
+                res |= GPW_CCLASS_TWO_DIGIT;
+            else
+                res |= GPW_CCLASS_DIGIT;
+
+        } else if (islower(ch)) {
+            cta[REF_CC_LOWER]++;
+
+            if ((res & GPW_CCLASS_LOWER) != 0)
+                res |= GPW_CCLASS_TWO_LOWER;
+            else
+                res |= GPW_CCLASS_ALPHA | GPW_CCLASS_LOWER;
+
+        } else if (isupper(ch)) {
+            cta[REF_CC_UPPER]++;
+
+            if ((res & GPW_CCLASS_UPPER) != 0)
+                res |= GPW_CCLASS_TWO_UPPER;
+            else
+                res |= GPW_CCLASS_ALPHA | GPW_CCLASS_UPPER;
+
+        } else if (! no_spec) {
+            cta[REF_CC_SPECIAL]++;
+            if ((res & GPW_CCLASS_SPECIAL) != 0)
+                res |= GPW_CCLASS_TWO_SPECIAL;
+            else
+                res |= GPW_CCLASS_SPECIAL;
+
+            switch (ch) {
+            case '/': scan[-1] = spec[0]; break;
+            case '+': scan[-1] = spec[1]; break;
+            }
+
+        /*
+         *  Found a special character, but no specials are allowed.
+         */
+        } else
+            res |= ref_pick_something(res, scan-1, cta);
+    }
+}
+
+static char *
+ref_find_upper(char * pw)
+{
+    pw += strlen(pw);
+    for (;;) {
+        if (isupper((unsigned int)*--pw))
+            return pw;
+    }
+}
+
+static char *
+ref_find_lower(char * pw)
+{
+    pw += strlen(pw);
+    for (;;) {
+        if (islower((unsigned int)*--pw))
+            return pw;
+    }
+}
+
+static char *
+ref_find_digit(char * pw)
+{
+    pw += strlen(pw);
+    for (;;) {
+        if (isdigit((unsigned int)*--pw))
+            return pw;
+    }
+}
+
+static char *
+ref_find_special(char * pw)
+{
+    pw += strlen(pw);
+    for (;;) {
+        if (ispunct((unsigned int)*--pw))
+            return pw;
+    }
+}
+
+static void
+ref_add_upper(char * pw, int * cta)
+{
+    if (cta[REF_CC_LOWER] > 2) {
+        pw = ref_find_lower(pw);
+        cta[REF_CC_LOWER]--;
+
+    } else if (cta[REF_CC_DIGIT] > 2) {
+        pw = ref_find_digit(pw);
+        cta[REF_CC_DIGIT]--;
+
+    } else {
+        pw = ref_find_special(pw);
+        cta[REF_CC_SPECIAL]--;
+    }
+
+    *pw = 'A' + (*pw & 0x0F);
+    cta[REF_CC_UPPER]++;
+}
+
+static void
+ref_add_lower(char * pw, int * cta)
+{
+    if (cta[REF_CC_UPPER] > 2) {
+        pw = ref_find_upper(pw);
+        cta[REF_CC_UPPER]--;
+
+    } else if (cta[REF_CC_DIGIT] > 2) {
+        pw = ref_find_digit(pw);
+        cta[REF_CC_DIGIT]--;
+
+    } else {
+        pw = ref_find_special(pw);
+        cta[REF_CC_SPECIAL]--;
+    }
+
+    *pw = 'a' + (*pw & 0x0F);
+    cta[REF_CC_LOWER]++;
+}
+
+static void
+ref_add_digit(char * pw, int * cta)
+{
+    if (cta[REF_CC_UPPER] > 2) {
+        pw = ref_find_upper(pw);
+        cta[REF_CC_UPPER]--;
+
+    } else if (cta[REF_CC_LOWER] > 2) {
+        pw = ref_find_lower(pw);
+        cta[REF_CC_LOWER]--;
+
+    } else {
+        pw = ref_find_special(pw);
+        cta[REF_CC_SPECIAL]--;
+    }
+
+    *pw = '0' + (*pw & 0x07);
+    cta[REF_CC_DIGIT]++;
+}
+
+static void
+ref_add_special(char * pw, int * cta, char const * spec)
+{
+    if (cta[REF_CC_DIGIT] > 2) {
+        pw = ref_find_digit(pw);
+        cta[REF_CC_DIGIT]--;
+
+    } else if (cta[REF_CC_LOWER] > 2) {
+        pw = ref_find_lower(pw);
+        cta[REF_CC_LOWER]--;
+
+    } else {
+        pw = ref_find_upper(pw);
+        cta[REF_CC_UPPER]--;
+    }
+
+    {
+        int ix = cta[REF_CC_SPECIAL]++;
+        if (ix > 2)
+            ix = 2;
+        *pw = spec[ix];
+    }
+}
+
+/**
+ * fiddle the password to comply with requirements.  Special characters may be
+ * required or prohibited.  Both upper and lower case letters may be required.
+ * The password may be forced to be all digits.  The @code{--class} option
+ * should be specific to each password id. If "ref_clean_no_three()" makes changes,
+ * then we need to sanity check the result. It's possible a minimum count of
+ * a character class get violated.
+ *
+ * Except for when special characters are required, with reasonable length
+ * passwords, it is unusual for this fixup function to do anything.
+ *
+ * @param[in,out] pw  the password buffer
+ * @param[in]  cclass    the GPW_CCLASS_* requirements
+ * @param[in]  spec      the three special characters
+ *
+ * [test] Some "--specials" values never settle, so this gives up
+ * after REF_MAX_ROUNDS rounds.  It returns false if it or
+ * ref_clean_no_three() gave up.
+ */
+static bool
+ref_fix_std_pw(char * pw, uint32_t cclass, char const * spec)
+{
+    int cta[4];
+    int rounds = REF_MAX_ROUNDS; // [test]
+    uint32_t need;
+
+    ref_gave_up = false; // [test]
+
+    for (;;) {
+        need = ref_count_pw_class(pw, cclass, spec, cta);
+        need = (need & cclass) ^ cclass;
+
+        /*
+         * IF there are any needs, it is probably because special chars are
+         * required, but none got into the result.
+         */
+        if (UNLIKELY(need != 0)) {
+
+            if (ISLIKELY((need & GPW_CCLASS_SPECIAL) != 0))
+                ref_add_special(pw, cta, spec);
+
+            if (UNLIKELY((need & GPW_CCLASS_TWO_SPECIAL) != 0))
+                ref_add_special(pw, cta, spec); // unusual requirement
+
+            /*
+             * "need" are the bits in cclass not found by ref_count_pw_class
+             *
+             * requiring "alpha" is always one-only and can never be in
+             * conjunction with upper or lower.
+             */
+            if ((need & GPW_CCLASS_ALPHA) != 0)
+                ref_add_upper(pw, cta);
+
+            else {
+                if ((need & GPW_CCLASS_UPPER) != 0)
+                    ref_add_upper(pw, cta);
+
+                if (UNLIKELY((need & GPW_CCLASS_TWO_UPPER) != 0))
+                    ref_add_upper(pw, cta);
+
+                if ((need & GPW_CCLASS_LOWER) != 0)
+                    ref_add_lower(pw, cta);
+
+                if (UNLIKELY((need & GPW_CCLASS_TWO_LOWER) != 0))
+                    ref_add_lower(pw, cta);
+            }
+
+            if ((need & GPW_CCLASS_DIGIT) != 0)
+                ref_add_digit(pw, cta);
+
+            if (UNLIKELY((need & GPW_CCLASS_TWO_DIGIT) != 0))
+                ref_add_digit(pw, cta);
+        }
+
+        if (ISLIKELY((cclass & GPW_CCLASS_NO_THREE) == 0))
+            return ! ref_gave_up; // [test]
+
+        if (ISLIKELY(! ref_clean_no_three(pw, cclass, spec)))
+            return ! ref_gave_up; // [test]
+        /*
+         * "ref_clean_no_three()" did some cleaning, so recompute
+         * the satisfied classes and try again.
+         */
+        if (--rounds <= 0) // [test]
+            return false;
+    }
+}
+
+/**
+ * Make up a consistent set of GPW_CCLASS_* requirements,
+ * the way the "--cclass" option handling would.
+ */
+static uint32_t
+prop_cclass(void)
+{
+    static uint32_t const allowed =
+        GPW_CCLASS_ALPHA | GPW_CCLASS_UPPER | GPW_CCLASS_LOWER
+        | GPW_CCLASS_DIGIT | GPW_CCLASS_SPECIAL | GPW_CCLASS_NO_SPECIAL
+        | GPW_CCLASS_NO_TRIPLETS | GPW_CCLASS_NO_SEQUENCE
+        | GPW_CCLASS_TWO_UPPER | GPW_CCLASS_TWO_LOWER
+        | GPW_CCLASS_TWO_DIGIT | GPW_CCLASS_TWO_SPECIAL;
+
+    uint32_t cc = (uint32_t)prop_rand() & allowed;
+
+    if (cc & (GPW_CCLASS_UPPER | GPW_CCLASS_LOWER
+              | GPW_CCLASS_TWO_UPPER | GPW_CCLASS_TWO_LOWER))
+        cc &= ~GPW_CCLASS_ALPHA;
+    if (cc & GPW_CCLASS_TWO_UPPER)
+        cc |= GPW_CCLASS_UPPER;
+    if (cc & GPW_CCLASS_TWO_LOWER)
+        cc |= GPW_CCLASS_LOWER;
+    if (cc & GPW_CCLASS_TWO_DIGIT)
+        cc |= GPW_CCLASS_DIGIT;
+    if (cc & GPW_CCLASS_NO_SPECIAL)
+        cc &= ~(GPW_CCLASS_SPECIAL | GPW_CCLASS_TWO_SPECIAL);
+    if (cc & GPW_CCLASS_TWO_SPECIAL)
+        cc |= GPW_CCLASS_SPECIAL;
+    return cc;
+}
+
+/**
+ * The specials that cannot clean triplets or sequences.  This mirrors
+ * the check in sanity_check_cclass().
+ */
+static bool
+prop_bad_spec(char const * spec)
+{
+    return (spec[2] == spec[0]) || (spec[2] == spec[1])
+        || (spec[2] == '+')     || (spec[2] == '/');
+}
+
+/**
+ * Make up a password to fix.  Some have runs of repeated or
+ * ascending characters, so that there is something to clean.
+ */
+static void
+prop_password(char * pw)
+{
+    int  len  = GPW_MIN_PW_LENGTH
+        + (int)(prop_rand() % (GPW_MAX_LENGTH - GPW_MIN_PW_LENGTH + 1));
+    int  mode = (int)(prop_rand() % 4);
+    int  ix;
+
+    for (ix = 0; ix < len; ix++) {
+        unsigned char ch = (unsigned char)prop_b64[prop_rand() % 64];
+
+        if ((ix > 0) && ((prop_rand() % 3) == 0)) {
+            unsigned char prev = (unsigned char)pw[ix - 1];
+            if (mode == 1)
+                ch = prev;
+            else if ((mode == 2) && isalnum(prev + 1))
+                ch = prev + 1;
+        }
+        pw[ix] = (char)ch;
+    }
+    pw[len] = NUL;
+}
+
+int
+main(int argc, char ** argv)
+{
+    char const * env   = getenv("FIX_PW_PROP_COUNT");
+    long         count = (env != NULL) ? atol(env) : PROP_DFT_COUNT;
+    long         fails = 0, unsettled = 0, ix;
+
+    (void)argc;
+    env = getenv("FIX_PW_PROP_SEED");
+    if ((env != NULL) && (strtoull(env, NULL, 0) != 0))
+        prop_rand_state = strtoull(env, NULL, 0);
+
+    for (ix = 0; ix < count; ix++) {
+        char     pw[GPW_PW_BUF_SIZE], ref[GPW_PW_BUF_SIZE];
+        char     spec[4];
+        uint32_t cc = prop_cclass();
+        bool     settled;
+
+        spec[0] = prop_spec[prop_rand() % (sizeof(prop_spec) - 1)];
+        spec[1] = prop_spec[prop_rand() % (sizeof(prop_spec) - 1)];
+        spec[2] = prop_spec[prop_rand() % (sizeof(prop_spec) - 1)];
+        spec[3] = NUL;
+
+        prop_password(pw);
+        memcpy(ref, pw, sizeof(ref));
+        settled = fix_std_pw(pw, cc, spec);
+
+        /*
+         * Running out of rounds is only allowed with the specials that
+         * sanity_check_cclass() rejects.
+         */
+        if (! settled && ! prop_bad_spec(spec) && (fails++ < 10))
+            fprintf(stderr, "%s: cclass 0x%04X specials '%s' "
+                    "did not settle\n", argv[0], cc, spec);
+
+        /*
+         * When the old rounds never settle, there is nothing to compare.
+         */
+        if (! ref_fix_std_pw(ref, cc, spec)) {
+            unsettled++;
+            continue;
+        }
+
+        if (strcmp(pw, ref) != 0) {
+            if (fails++ < 10)
+                fprintf(stderr, "%s: cclass 0x%04X specials '%s'\n"
+                        "\tgot  %s\n\twant %s\n",
+                        argv[0], cc, spec, pw, ref);
+        }
+    }
+
+    printf("%ld cases, %ld differ, %ld never settled\n",
+           count, fails, unsettled);
+    return (fails == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-file-style: "stroustrup"
+ * indent-tabs-mode: nil
+ * End:
+ * end of fix-pw-prop.c */